@@ -0,0 +1,82 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef COMPLETIONWORD_H
+#define COMPLETIONWORD_H
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+/**
+ * Word built by CompletionIterator and PackedCompletionIterator: the prefix, followed by one letter for every
+ * level of the walk below it, in one fixed buffer. Both iterators check the length of the word only here,
+ * before they go one level deeper.
+ */
+class CompletionWord
+{
+public:
+    static const size_t KMaxLength = 255;
+
+    // Throws std::length_error if the prefix is longer than KMaxLength.
+    CompletionWord(const char *prefix, size_t length) :
+        mPrefixLength(length),
+        mLength(0)
+    {
+        if (length > KMaxLength) {
+            throw std::length_error("Prefix is too long");
+        }
+        memcpy(mLetters, prefix, length);
+        mLetters[length] = 0;
+    }
+
+    // Throws std::length_error if the prefix and depth letters below it leave no room for another letter.
+    void requireRoom(size_t depth) const {
+        if (mPrefixLength + depth >= KMaxLength) {
+            throw std::length_error("Word in the graph is too long");
+        }
+    }
+
+    // Sets the letter at given depth below the prefix, depth 0 being the first letter after it.
+    void setLetter(size_t depth, char letter) {
+        mLetters[mPrefixLength + depth] = letter;
+    }
+
+    // Ends the word after given number of letters below the prefix.
+    void end(size_t depth) {
+        mLength = mPrefixLength + depth;
+        mLetters[mLength] = 0;
+    }
+
+    const char* word() const {
+        return mLetters;
+    }
+
+    size_t length() const {
+        return mLength;
+    }
+
+    size_t prefixLength() const {
+        return mPrefixLength;
+    }
+
+private:
+    size_t mPrefixLength;
+    char mLetters[KMaxLength + 1];
+    size_t mLength;
+};
+
+#endif
@@ -0,0 +1,720 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dawg.h"
+
+#include <cstring>
+#include <ios>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DAWG_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+    // Number of lookups in flight in batched contains(). It should be enough to cover the memory latency
+    // with the work of the other lookups, but small enough for their lists to stay in L1.
+    const size_t KBatchWidth = 32;
+
+    template <class Format>
+    int scanScalar(const typename Format::Node *nodes, size_t /*nodeCount*/, int position, int letter) {
+        for (;; ++position) {
+            typename Format::Node node = nodes[position];
+            if (Format::letter(node) == letter) {
+                return position;
+            }
+            if (Format::isEndOfList(node)) {
+                return 0;
+            }
+        }
+    }
+
+#ifdef DAWG_X86_KERNELS
+    // The kernels compare the letters of several nodes at once and stop at the first node which either has
+    // the letter or ends the list. Most lists are just a few nodes long and a lookup is dominated by cache
+    // misses on them, so the first nodes are still scanned one by one, and only the long lists at the top
+    // of the graph are scanned in blocks. The blocks never reach past the last node, because the end of the
+    // mapping might be the end of a page; the last few nodes of the file are scanned one by one.
+    //
+    // The letter and the flags are in the low 32 bits of the nodes of every format, so the kernels compare
+    // 32-bit lanes and only keep the lanes holding them: every lane for 32-bit nodes, every other lane for
+    // 64-bit nodes.
+    const int KScalarPrologue = 4;
+
+    template <class Format>
+    struct Lanes {
+        static_assert(Format::KLetterBits <= 32 && Format::KEndOfListBit < 32,
+                      "Letter and End-Of-List flag have to be in the low 32 bits");
+        static const int KLanesPerNode = sizeof(typename Format::Node) / sizeof(int32_t);
+        static const unsigned int KMask = KLanesPerNode == 1 ? 0xFF : 0x55;
+        static const int KLetterMask = Format::KLetterMask;
+        static const int KEndOfListFlag = Format::KEndOfListFlag;
+    };
+
+    template <class Format>
+    __attribute__((target("sse2")))
+    int scanSse2(const typename Format::Node *nodes, size_t nodeCount, int position, int letter) {
+        for (int end = position + KScalarPrologue; position != end; ++position) {
+            typename Format::Node node = nodes[position];
+            if (Format::letter(node) == letter) {
+                return position;
+            }
+            if (Format::isEndOfList(node)) {
+                return 0;
+            }
+        }
+
+        const int nodesPerBlock = sizeof(__m128i) / sizeof(typename Format::Node);
+        const __m128i letterMask = _mm_set1_epi32(Lanes<Format>::KLetterMask);
+        const __m128i endFlag = _mm_set1_epi32(Lanes<Format>::KEndOfListFlag);
+        const __m128i wanted = _mm_set1_epi32(letter);
+
+        for (; (size_t)position + nodesPerBlock <= nodeCount; position += nodesPerBlock) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(nodes + position));
+            __m128i found = _mm_cmpeq_epi32(_mm_and_si128(block, letterMask), wanted);
+            __m128i end = _mm_cmpeq_epi32(_mm_and_si128(block, endFlag), endFlag);
+            unsigned int foundMask = _mm_movemask_ps(_mm_castsi128_ps(found)) & Lanes<Format>::KMask;
+            unsigned int stopMask = foundMask | (_mm_movemask_ps(_mm_castsi128_ps(end)) & Lanes<Format>::KMask);
+            if (stopMask != 0) {
+                int lane = __builtin_ctz(stopMask);
+                return (foundMask >> lane) & 1 ? position + lane / Lanes<Format>::KLanesPerNode : 0;
+            }
+        }
+        return scanScalar<Format>(nodes, nodeCount, position, letter);
+    }
+
+    template <class Format>
+    __attribute__((target("avx2")))
+    int scanAvx2(const typename Format::Node *nodes, size_t nodeCount, int position, int letter) {
+        for (int end = position + KScalarPrologue; position != end; ++position) {
+            typename Format::Node node = nodes[position];
+            if (Format::letter(node) == letter) {
+                return position;
+            }
+            if (Format::isEndOfList(node)) {
+                return 0;
+            }
+        }
+
+        const int nodesPerBlock = sizeof(__m256i) / sizeof(typename Format::Node);
+        const __m256i letterMask = _mm256_set1_epi32(Lanes<Format>::KLetterMask);
+        const __m256i endFlag = _mm256_set1_epi32(Lanes<Format>::KEndOfListFlag);
+        const __m256i wanted = _mm256_set1_epi32(letter);
+
+        for (; (size_t)position + nodesPerBlock <= nodeCount; position += nodesPerBlock) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(nodes + position));
+            __m256i found = _mm256_cmpeq_epi32(_mm256_and_si256(block, letterMask), wanted);
+            __m256i end = _mm256_cmpeq_epi32(_mm256_and_si256(block, endFlag), endFlag);
+            unsigned int foundMask = _mm256_movemask_ps(_mm256_castsi256_ps(found)) & Lanes<Format>::KMask;
+            unsigned int stopMask = foundMask | (_mm256_movemask_ps(_mm256_castsi256_ps(end)) & Lanes<Format>::KMask);
+            if (stopMask != 0) {
+                int lane = __builtin_ctz(stopMask);
+                return (foundMask >> lane) & 1 ? position + lane / Lanes<Format>::KLanesPerNode : 0;
+            }
+        }
+        return scanSse2<Format>(nodes, nodeCount, position, letter);
+    }
+#endif
+}
+
+class Dawg::NodesLoader
+{
+public:
+    NodesLoader(Dawg &dawg, const dawg_header &header, const char *data) :
+        mDawg(dawg),
+        mHeader(header),
+        mData(data),
+        mLoaded(false)
+    {
+    }
+
+    template <class Format>
+    void visit() {
+        const dawg_section *nodes = dawg_find_section(&mHeader, DAWG_SECTION_NODES);
+        if (mHeader.node_count < 1 || mHeader.node_count > Format::KMaxNodeCount || nodes == NULL ||
+            nodes->size != mHeader.node_count * sizeof(typename Format::Node)) {
+            return;
+        }
+        // The mapping is page aligned and the sections are aligned to cache lines
+        mDawg.setNodes(reinterpret_cast<const typename Format::Node*>(mData + nodes->offset));
+        mLoaded = true;
+    }
+
+    bool loaded() const {
+        return mLoaded;
+    }
+
+private:
+    Dawg &mDawg;
+    const dawg_header &mHeader;
+    const char *mData;
+    bool mLoaded;
+};
+
+Dawg::Dawg(const char *fileName) :
+    mFile(fileName, MappedFile::KRandomAccess),
+    mNodes(NULL),
+    mWideNodes(NULL),
+    mNodeCount(0),
+    mWordCounts(NULL),
+    mScanList(scanScalar<NarrowNodeFormat>),
+    mScanWideList(scanScalar<WideNodeFormat>)
+{
+    dawg_header header;
+    if (dawg_read_header(&header, mFile.data(), mFile.size())) {
+        NodesLoader loader(*this, header, mFile.data());
+        const dawg_section *counts = dawg_find_section(&header, DAWG_SECTION_WORD_COUNTS);
+        if (!SupportedNodeFormats::dispatch(header, loader) || !loader.loaded() ||
+            (counts != NULL && counts->size != header.node_count * sizeof(uint32_t))) {
+            throw ios_base::failure(string("Invalid DAWG file ") + fileName);
+        }
+
+        mNodeCount = header.node_count;
+        if (counts != NULL) {
+            mWordCounts = reinterpret_cast<const uint32_t*>(mFile.data() + counts->offset);
+        }
+    } else {
+        int32_t nodeCount = 0;
+        if (mFile.size() >= sizeof(nodeCount)) {
+            memcpy(&nodeCount, mFile.data(), sizeof(nodeCount));
+        }
+        if (nodeCount < 1 || mFile.size() != sizeof(nodeCount) + (size_t)nodeCount * sizeof(int32_t)) {
+            throw ios_base::failure(string("Invalid DAWG file ") + fileName);
+        }
+
+        setNodes(reinterpret_cast<const NarrowNodeFormat::Node*>(mFile.data() + sizeof(nodeCount)));
+        mNodeCount = nodeCount;
+    }
+
+    if (isSupported(KAvx2Scan)) {
+        setScanKernel(KAvx2Scan);
+    } else if (isSupported(KSse2Scan)) {
+        setScanKernel(KSse2Scan);
+    }
+}
+
+bool Dawg::isSupported(ScanKernel kernel) {
+    switch (kernel) {
+    case KScalarScan:
+        return true;
+#ifdef DAWG_X86_KERNELS
+    case KSse2Scan:
+        return __builtin_cpu_supports("sse2");
+    case KAvx2Scan:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+void Dawg::setScanKernel(ScanKernel kernel) {
+    if (!isSupported(kernel)) {
+        throw invalid_argument("Scan kernel is not supported by this CPU");
+    }
+    switch (kernel) {
+#ifdef DAWG_X86_KERNELS
+    case KSse2Scan:
+        mScanList = scanSse2<NarrowNodeFormat>;
+        mScanWideList = scanSse2<WideNodeFormat>;
+        break;
+    case KAvx2Scan:
+        mScanList = scanAvx2<NarrowNodeFormat>;
+        mScanWideList = scanAvx2<WideNodeFormat>;
+        break;
+#endif
+    default:
+        mScanList = scanScalar<NarrowNodeFormat>;
+        mScanWideList = scanScalar<WideNodeFormat>;
+        break;
+    }
+}
+
+void Dawg::contains(const string *words, size_t count, bool *results) const {
+    if (mWideNodes != NULL) {
+        contains<WideNodeFormat>(mWideNodes, words, count, results);
+    } else {
+        contains<NarrowNodeFormat>(mNodes, words, count, results);
+    }
+}
+
+template <class Format>
+void Dawg::contains(const typename Format::Node *nodes, const string *words, size_t count, bool *results) const {
+    struct Lookup {
+        const char *mWord;
+        size_t mLength;
+        size_t mLetter;
+        int mPosition;
+        size_t mIndex;
+    };
+
+    Lookup lookups[KBatchWidth];
+    size_t activeLookups = 0;
+    size_t nextWord = 0;
+
+    // Puts the next word with at least one letter in given slot. Returns false if there are no more words.
+    auto startLookup = [&](Lookup &lookup) {
+        for (; nextWord != count; ++nextWord) {
+            if (words[nextWord].empty() || mNodeCount < 2) {
+                results[nextWord] = false;
+                continue;
+            }
+            Lookup started = { words[nextWord].data(), words[nextWord].length(), 0, 1, nextWord };
+            lookup = started;
+            ++nextWord;
+            return true;
+        }
+        return false;
+    };
+
+    while (activeLookups != KBatchWidth && startLookup(lookups[activeLookups])) {
+        ++activeLookups;
+    }
+
+    while (activeLookups != 0) {
+        for (size_t i = 0; i < activeLookups;) {
+            Lookup &lookup = lookups[i];
+            int position = scanList(nodes, lookup.mPosition, static_cast<unsigned char>(lookup.mWord[lookup.mLetter]));
+
+            bool finished = true;
+            bool found = false;
+            if (position == 0) {
+                // No such letter
+            } else if (++lookup.mLetter == lookup.mLength) {
+                found = Format::isEndOfWord(nodes[position]);
+            } else {
+                lookup.mPosition = Format::firstChild(nodes[position]);
+                if (lookup.mPosition != 0) {
+                    __builtin_prefetch(nodes + lookup.mPosition);
+                    finished = false;
+                }
+            }
+
+            if (!finished) {
+                ++i;
+                continue;
+            }
+            results[lookup.mIndex] = found;
+            if (!startLookup(lookup)) {
+                lookup = lookups[--activeLookups];
+            }
+        }
+    }
+}
+
+size_t Dawg::wordCount() const {
+    requireWordCounts();
+    return mNodeCount > 1 ? mWordCounts[1] : 0;
+}
+
+size_t Dawg::indexOf(const char *word, size_t length) const {
+    requireWordCounts();
+    return mWideNodes != NULL ? indexOf<WideNodeFormat>(mWideNodes, word, length) :
+                                 indexOf<NarrowNodeFormat>(mNodes, word, length);
+}
+
+// The words of a list go in order of its nodes, and the word ending at a node goes before the words below
+// it. So the index of a word is the sum of the words through the earlier brothers on every level of its
+// path, plus one for every proper prefix of the word that is a word itself.
+template <class Format>
+size_t Dawg::indexOf(const typename Format::Node *nodes, const char *word, size_t length) const {
+    if (length == 0 || mNodeCount < 2) {
+        return KNoWord;
+    }
+
+    size_t index = 0;
+    int list = 1;
+    for (size_t i = 0;; ++i) {
+        int position = scanList(nodes, list, static_cast<unsigned char>(word[i]));
+        if (position == 0) {
+            return KNoWord;
+        }
+        index += mWordCounts[list] - mWordCounts[position];
+
+        typename Format::Node node = nodes[position];
+        if (i + 1 == length) {
+            return Format::isEndOfWord(node) ? index : KNoWord;
+        }
+        if (Format::isEndOfWord(node)) {
+            ++index;
+        }
+        list = Format::firstChild(node);
+        if (list == 0) {
+            return KNoWord;
+        }
+    }
+}
+
+size_t Dawg::wordAt(size_t index, char *buffer, size_t bufferSize) const {
+    if (index >= wordCount()) {
+        throw out_of_range("No word with such index");
+    }
+    return mWideNodes != NULL ? wordAt<WideNodeFormat>(mWideNodes, index, buffer, bufferSize) :
+                                 wordAt<NarrowNodeFormat>(mNodes, index, buffer, bufferSize);
+}
+
+template <class Format>
+size_t Dawg::wordAt(const typename Format::Node *nodes, size_t index, char *buffer, size_t bufferSize) const {
+    size_t length = 0;
+    for (int position = 1;; ++position) {
+        uint32_t words = wordsThrough<Format>(nodes, position);
+        if (index >= words) {
+            index -= words;
+            continue;
+        }
+
+        if (length + 1 >= bufferSize) {
+            throw length_error("Buffer is too small for the word");
+        }
+        typename Format::Node node = nodes[position];
+        buffer[length++] = Format::letter(node);
+        if (Format::isEndOfWord(node)) {
+            if (index == 0) {
+                buffer[length] = 0;
+                return length;
+            }
+            --index;
+        }
+        // The loop increments it back to the first child
+        position = Format::firstChild(node) - 1;
+    }
+}
+
+size_t Dawg::countWithPrefix(const char *prefix, size_t length) const {
+    requireWordCounts();
+    if (length == 0) {
+        return wordCount();
+    }
+    int node = findNode(prefix, length);
+    if (node == 0) {
+        return 0;
+    }
+    return mWideNodes != NULL ? wordsThrough<WideNodeFormat>(mWideNodes, node) : wordsThrough<NarrowNodeFormat>(mNodes, node);
+}
+
+void Dawg::requireWordCounts() const {
+    if (mWordCounts == NULL) {
+        throw logic_error("DAWG file has no word counts");
+    }
+}
+
+int Dawg::findNode(const char *word, size_t length) const {
+    return mWideNodes != NULL ? findNode<WideNodeFormat>(mWideNodes, word, length) :
+                                 findNode<NarrowNodeFormat>(mNodes, word, length);
+}
+
+template <class Format>
+int Dawg::findNode(const typename Format::Node *nodes, const char *word, size_t length) const {
+    if (length == 0 || mNodeCount < 2) {
+        return 0;
+    }
+
+    int position = 1;
+    for (size_t i = 0;; ++i) {
+        position = scanList(nodes, position, static_cast<unsigned char>(word[i]));
+        if (position == 0 || i + 1 == length) {
+            return position;
+        }
+        position = Format::firstChild(nodes[position]);
+        if (position == 0) {
+            return 0;
+        }
+    }
+}
+
+CompletionIterator::CompletionIterator(const Dawg &dawg, const char *prefix, size_t length, size_t limit) :
+    mNodes(dawg.nodes()),
+    mWideNodes(dawg.wideNodes()),
+    mRemaining(limit),
+    mPrefixIsWord(false),
+    mDepth(0),
+    mFirstList(0),
+    mWord(prefix, length)
+{
+    if (length == 0) {
+        mFirstList = dawg.nodeCount() > 1 ? 1 : 0;
+    } else {
+        int node = dawg.findNode(prefix, length);
+        if (node != 0) {
+            mPrefixIsWord = WideNodeFormat::isEndOfWord(dawg.wideNode(node));
+            mFirstList = WideNodeFormat::firstChild(dawg.wideNode(node));
+        }
+    }
+}
+
+bool CompletionIterator::next() {
+    return mWideNodes != NULL ? next<WideNodeFormat>(mWideNodes) : next<NarrowNodeFormat>(mNodes);
+}
+
+template <class Format>
+bool CompletionIterator::next(const typename Format::Node *nodes) {
+    if (mRemaining == 0) {
+        return false;
+    }
+
+    if (mPrefixIsWord) {
+        mPrefixIsWord = false;
+        mWord.end(0);
+        --mRemaining;
+        return true;
+    }
+
+    while (advance<Format>(nodes)) {
+        typename Format::Node node = nodes[mStack[mDepth - 1]];
+        mWord.setLetter(mDepth - 1, Format::letter(node));
+        if (Format::isEndOfWord(node)) {
+            mWord.end(mDepth);
+            --mRemaining;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Format>
+bool CompletionIterator::advance(const typename Format::Node *nodes) {
+    if (mDepth == 0) {
+        if (mFirstList == 0) {
+            return false;
+        }
+        mWord.requireRoom(mDepth);
+        mStack[mDepth++] = mFirstList;
+        mFirstList = 0;
+        return true;
+    }
+
+    int firstChild = Format::firstChild(nodes[mStack[mDepth - 1]]);
+    if (firstChild != 0) {
+        mWord.requireRoom(mDepth);
+        mStack[mDepth++] = firstChild;
+        return true;
+    }
+
+    // Go to the next brother, or the next brother of the closest ancestor that has one
+    while (Format::isEndOfList(nodes[mStack[mDepth - 1]])) {
+        if (--mDepth == 0) {
+            return false;
+        }
+    }
+    ++mStack[mDepth - 1];
+    return true;
+}
+
+AnagramIterator::AnagramIterator(const Dawg &dawg, const char *rack, size_t length, bool useAllTiles) :
+    mNodes(dawg.nodes()),
+    mWideNodes(dawg.wideNodes()),
+    mUseAllTiles(useAllTiles),
+    // Empty graph doesn't even have the root list, so there is nothing to start
+    mStarted(dawg.nodeCount() < 2),
+    mBlanks(0),
+    mTilesLeft(length),
+    mDepth(0)
+{
+    if (length > KMaxRackSize) {
+        throw length_error("Rack is too large");
+    }
+    memset(mTiles, 0, sizeof(mTiles));
+    for (size_t i = 0; i != length; ++i) {
+        if (rack[i] == KBlankTile) {
+            ++mBlanks;
+        } else {
+            ++mTiles[static_cast<unsigned char>(rack[i])];
+        }
+    }
+    mWord[0] = 0;
+}
+
+bool AnagramIterator::next() {
+    return mWideNodes != NULL ? next<WideNodeFormat>(mWideNodes) : next<NarrowNodeFormat>(mNodes);
+}
+
+template <class Format>
+bool AnagramIterator::next(const typename Format::Node *nodes) {
+    while (advance<Format>(nodes)) {
+        typename Format::Node node = nodes[mStack[mDepth - 1]];
+        if (Format::isEndOfWord(node) && (!mUseAllTiles || mTilesLeft == 0)) {
+            mWord[mDepth] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Format>
+bool AnagramIterator::advance(const typename Format::Node *nodes) {
+    if (mDepth == 0) {
+        if (mStarted) {
+            return false;
+        }
+        mStarted = true;
+        mStack[mDepth++] = 1;
+        return take<Format>(nodes) || skip<Format>(nodes);
+    }
+
+    int firstChild = Format::firstChild(nodes[mStack[mDepth - 1]]);
+    if (firstChild != 0 && mTilesLeft != 0) {
+        mStack[mDepth++] = firstChild;
+        return take<Format>(nodes) || skip<Format>(nodes);
+    }
+
+    release(mDepth - 1);
+    return skip<Format>(nodes);
+}
+
+template <class Format>
+bool AnagramIterator::skip(const typename Format::Node *nodes) {
+    for (;;) {
+        if (!Format::isEndOfList(nodes[mStack[mDepth - 1]])) {
+            ++mStack[mDepth - 1];
+            if (take<Format>(nodes)) {
+                return true;
+            }
+            continue;
+        }
+
+        if (--mDepth == 0) {
+            return false;
+        }
+        release(mDepth - 1);
+    }
+}
+
+template <class Format>
+bool AnagramIterator::take(const typename Format::Node *nodes) {
+    size_t depth = mDepth - 1;
+    unsigned char letter = Format::letter(nodes[mStack[depth]]);
+    if (mTiles[letter] != 0) {
+        --mTiles[letter];
+        mUsedBlank[depth] = false;
+    } else if (mBlanks != 0) {
+        --mBlanks;
+        mUsedBlank[depth] = true;
+    } else {
+        return false;
+    }
+    --mTilesLeft;
+    mWord[depth] = letter;
+    return true;
+}
+
+void AnagramIterator::release(size_t depth) {
+    if (mUsedBlank[depth]) {
+        ++mBlanks;
+    } else {
+        ++mTiles[static_cast<unsigned char>(mWord[depth])];
+    }
+    ++mTilesLeft;
+}
+
+FuzzyIterator::FuzzyIterator(const Dawg &dawg, const char *query, size_t length, size_t maxDistance) :
+    mNodes(dawg.nodes()),
+    mWideNodes(dawg.wideNodes()),
+    mStarted(dawg.nodeCount() < 2),
+    mQueryLength(length),
+    mMaxDistance(maxDistance),
+    mDepth(0)
+{
+    if (length > KMaxQueryLength) {
+        throw length_error("Query is too long");
+    }
+    if (maxDistance > KMaxDistance) {
+        throw invalid_argument("Edit distance is too large");
+    }
+    memcpy(mQuery, query, length);
+
+    for (size_t j = 0; j <= length; ++j) {
+        mRows[0][j] = min(j, maxDistance + 1);
+    }
+    mWord[0] = 0;
+}
+
+bool FuzzyIterator::next() {
+    return mWideNodes != NULL ? next<WideNodeFormat>(mWideNodes) : next<NarrowNodeFormat>(mNodes);
+}
+
+template <class Format>
+bool FuzzyIterator::next(const typename Format::Node *nodes) {
+    while (advance<Format>(nodes)) {
+        typename Format::Node node = nodes[mStack[mDepth - 1]];
+        if (Format::isEndOfWord(node) && mRows[mDepth][mQueryLength] <= mMaxDistance) {
+            mWord[mDepth] = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Format>
+bool FuzzyIterator::advance(const typename Format::Node *nodes) {
+    if (mDepth == 0) {
+        if (mStarted) {
+            return false;
+        }
+        mStarted = true;
+        mStack[mDepth++] = 1;
+        return enter<Format>(nodes) || skip<Format>(nodes);
+    }
+
+    // Every letter beyond the query length costs one insertion
+    int firstChild = Format::firstChild(nodes[mStack[mDepth - 1]]);
+    if (firstChild != 0 && mDepth < mQueryLength + mMaxDistance) {
+        mStack[mDepth++] = firstChild;
+        return enter<Format>(nodes) || skip<Format>(nodes);
+    }
+    return skip<Format>(nodes);
+}
+
+template <class Format>
+bool FuzzyIterator::skip(const typename Format::Node *nodes) {
+    for (;;) {
+        if (!Format::isEndOfList(nodes[mStack[mDepth - 1]])) {
+            ++mStack[mDepth - 1];
+            if (enter<Format>(nodes)) {
+                return true;
+            }
+            continue;
+        }
+
+        if (--mDepth == 0) {
+            return false;
+        }
+    }
+}
+
+template <class Format>
+bool FuzzyIterator::enter(const typename Format::Node *nodes) {
+    char letter = Format::letter(nodes[mStack[mDepth - 1]]);
+    mWord[mDepth - 1] = letter;
+
+    const unsigned char *previous = mRows[mDepth - 1];
+    unsigned char *current = mRows[mDepth];
+    unsigned char cap = mMaxDistance + 1;
+
+    current[0] = min(mDepth, mMaxDistance + 1);
+    unsigned char best = current[0];
+    for (size_t j = 1; j <= mQueryLength; ++j) {
+        unsigned char cost = previous[j - 1] + (mQuery[j - 1] != letter);
+        cost = min(cost, (unsigned char)(previous[j] + 1));
+        cost = min(cost, (unsigned char)(current[j - 1] + 1));
+        current[j] = min(cost, cap);
+        best = min(best, current[j]);
+    }
+    return best <= mMaxDistance;
+}
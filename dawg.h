@@ -0,0 +1,417 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DAWG_H
+#define DAWG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include "completionword.h"
+#include "dawgformat.h"
+#include "mappedfile.h"
+#include "nodeformat.h"
+
+/**
+ * Read-only DAWG loaded from Word-List.dat. The file is memory mapped, so loading it takes a few system calls
+ * regardless of its size, and the queries walk the mapped nodes directly without allocating anything.
+ *
+ * The file has the header described in dawgformat.h, followed by the nodes section with the nodes (including
+ * the empty node 0) as 32-bit ints, or 64-bit ints for large graphs, in one of the SupportedNodeFormats of
+ * nodeformat.h. The root list starts at node 1, and every node holds its letter, flags and the index of its
+ * first child (0 if it has none). Children of a node are consecutive nodes up to the one with End-Of-List flag.
+ * The optional word counts section holds one unsigned 32-bit int per node, the number of words which go
+ * through the node or any of its further brothers (0 for node 0).
+ *
+ * Only the header is validated when the file is loaded; the child indices are trusted. Files written before
+ * the header was introduced, with just the node count before the 32-bit nodes, are still loaded, without
+ * word counts.
+ */
+class Dawg
+{
+public:
+    // Kernels finding a letter in a list of children. The best one supported by the CPU is picked when the
+    // DAWG is loaded; the others are only useful for benchmarks.
+    enum ScanKernel {
+        KScalarScan,
+        KSse2Scan,
+        KAvx2Scan
+    };
+
+    // Throws std::ios_base::failure if the file cannot be mapped, its sections don't match the header, or
+    // its nodes are neither 32-bit nor 64-bit nodes.
+    explicit Dawg(const char *fileName);
+
+    bool contains(const char *word, size_t length) const {
+        int node = findNode(word, length);
+        return node != 0 && WideNodeFormat::isEndOfWord(wideNode(node));
+    }
+
+    bool contains(const std::string &word) const {
+        return contains(word.data(), word.length());
+    }
+
+    // Checks many words at once, storing the result for words[i] in results[i]. Several lookups advance in
+    // turns and every lookup prefetches its next list before the others take their turns, so the cache
+    // misses of different lookups overlap instead of following one another.
+    void contains(const std::string *words, size_t count, bool *results) const;
+
+    // Every word starts with an empty prefix, so it's true for an empty prefix unless the DAWG is empty.
+    bool hasPrefix(const char *prefix, size_t length) const {
+        return length == 0 ? mNodeCount > 1 : findNode(prefix, length) != 0;
+    }
+
+    bool hasPrefix(const std::string &prefix) const {
+        return hasPrefix(prefix.data(), prefix.length());
+    }
+
+    bool hasWideNodes() const {
+        return mWideNodes != NULL;
+    }
+
+    // Only one of them is set, depending on the width of the nodes in the file.
+    const NarrowNodeFormat::Node* nodes() const {
+        return mNodes;
+    }
+
+    const WideNodeFormat::Node* wideNodes() const {
+        return mWideNodes;
+    }
+
+    // Node at given position in WideNodeFormat, whatever the format of the nodes in the file.
+    WideNodeFormat::Node wideNode(int position) const {
+        return mWideNodes != NULL ? mWideNodes[position] : WideNodeFormat::from<NarrowNodeFormat>(mNodes[position]);
+    }
+
+    size_t nodeCount() const {
+        return mNodeCount;
+    }
+
+    // Word counts are needed by the queries below, which throw std::logic_error if the file doesn't have them.
+    bool hasWordCounts() const {
+        return mWordCounts != NULL;
+    }
+
+    static const size_t KNoWord = static_cast<size_t>(-1);
+
+    size_t wordCount() const;
+
+    // Returns the position of the word in the order of CompletionIterator, from 0 to wordCount() - 1, or
+    // KNoWord if the DAWG doesn't contain the word.
+    size_t indexOf(const char *word, size_t length) const;
+
+    size_t indexOf(const std::string &word) const {
+        return indexOf(word.data(), word.length());
+    }
+
+    // Writes the word with given index to the buffer, null terminated, and returns its length. Throws
+    // std::out_of_range if there is no such word and std::length_error if the buffer is too small.
+    size_t wordAt(size_t index, char *buffer, size_t bufferSize) const;
+
+    // Number of words starting with the prefix, including the prefix itself.
+    size_t countWithPrefix(const char *prefix, size_t length) const;
+
+    size_t countWithPrefix(const std::string &prefix) const {
+        return countWithPrefix(prefix.data(), prefix.length());
+    }
+
+    static bool isSupported(ScanKernel kernel);
+
+    // Throws std::invalid_argument if the CPU doesn't support the kernel.
+    void setScanKernel(ScanKernel kernel);
+
+private:
+    friend class AnagramIterator;
+    friend class CompletionIterator;
+    friend class FuzzyIterator;
+
+    // Return the position of the node with given letter in the list starting at given position, or 0 if
+    // there is no such node.
+    typedef int (*ListScanner)(const NarrowNodeFormat::Node *nodes, size_t nodeCount, int position, int letter);
+    typedef int (*WideListScanner)(const WideNodeFormat::Node *nodes, size_t nodeCount, int position, int letter);
+
+    // Visitor of SupportedNodeFormats which points the DAWG at the nodes of the format in the file.
+    class NodesLoader;
+
+    Dawg(const Dawg&);
+    Dawg& operator=(const Dawg&);
+
+    void setNodes(const NarrowNodeFormat::Node *nodes) {
+        mNodes = nodes;
+    }
+
+    void setNodes(const WideNodeFormat::Node *nodes) {
+        mWideNodes = nodes;
+    }
+
+    int scanList(const NarrowNodeFormat::Node *nodes, int position, int letter) const {
+        return mScanList(nodes, mNodeCount, position, letter);
+    }
+
+    int scanList(const WideNodeFormat::Node *nodes, int position, int letter) const {
+        return mScanWideList(nodes, mNodeCount, position, letter);
+    }
+
+    // The public queries pick the format of the nodes once, and the templates below, instantiated for
+    // every format, walk them, so the format is never checked for every node.
+
+    // Returns the node for the last letter of the word, or 0 if the DAWG doesn't contain such path.
+    int findNode(const char *word, size_t length) const;
+    template <class Format>
+    int findNode(const typename Format::Node *nodes, const char *word, size_t length) const;
+
+    template <class Format>
+    void contains(const typename Format::Node *nodes, const std::string *words, size_t count, bool *results) const;
+    template <class Format>
+    size_t indexOf(const typename Format::Node *nodes, const char *word, size_t length) const;
+    template <class Format>
+    size_t wordAt(const typename Format::Node *nodes, size_t index, char *buffer, size_t bufferSize) const;
+
+    void requireWordCounts() const;
+
+    // Number of words going through the node itself.
+    template <class Format>
+    uint32_t wordsThrough(const typename Format::Node *nodes, int position) const {
+        uint32_t result = mWordCounts[position];
+        if (!Format::isEndOfList(nodes[position])) {
+            result -= mWordCounts[position + 1];
+        }
+        return result;
+    }
+
+    MappedFile mFile;
+    const NarrowNodeFormat::Node *mNodes;
+    const WideNodeFormat::Node *mWideNodes;
+    size_t mNodeCount;
+    const uint32_t *mWordCounts;
+    ListScanner mScanList;
+    WideListScanner mScanWideList;
+};
+
+/**
+ * Streams the words starting with given prefix, the prefix itself included, in graph order: depth first,
+ * with the children of every node in the order they are stored in its list. Only graphs built with
+ * --incremental keep the lists sorted, so only their words come out alphabetically. The walk keeps an
+ * explicit stack of positions and builds the words in one fixed buffer, so it doesn't allocate anything, and
+ * stopping after the first few words costs only as much as finding them.
+ *
+ *     for (CompletionIterator i(dawg, "TO", 2, 10); i.next();) {
+ *         puts(i.word());
+ *     }
+ */
+class CompletionIterator
+{
+public:
+    static const size_t KMaxWordLength = CompletionWord::KMaxLength;
+
+    // At most limit words are returned. Throws std::length_error if the prefix is longer than KMaxWordLength.
+    CompletionIterator(const Dawg &dawg, const char *prefix, size_t length,
+                       size_t limit = std::numeric_limits<size_t>::max());
+
+    // Moves to the next word. Returns false when there are no more words. Throws std::length_error if the
+    // graph contains a word longer than KMaxWordLength.
+    bool next();
+
+    // Null terminated, valid until the next call to next().
+    const char* word() const {
+        return mWord.word();
+    }
+
+    size_t length() const {
+        return mWord.length();
+    }
+
+private:
+    CompletionIterator(const CompletionIterator&);
+    CompletionIterator& operator=(const CompletionIterator&);
+
+    template <class Format>
+    bool next(const typename Format::Node *nodes);
+    // Moves to the next node in depth first order. Returns false when the whole subgraph below the prefix
+    // is visited.
+    template <class Format>
+    bool advance(const typename Format::Node *nodes);
+
+    // One of them is set, like in Dawg
+    const NarrowNodeFormat::Node *mNodes;
+    const WideNodeFormat::Node *mWideNodes;
+    size_t mRemaining;
+    bool mPrefixIsWord;
+
+    // mStack[i] is the position of the node for the letter at depth i below the prefix. mDepth is 0 before
+    // the walk starts and after it's finished.
+    int mStack[KMaxWordLength];
+    size_t mDepth;
+    int mFirstList;
+
+    CompletionWord mWord;
+};
+
+/**
+ * Streams the words that can be made from the tiles of a rack, like in Scrabble: every letter of the word
+ * takes one tile with that letter or one blank tile. The walk uses a fixed table of tile counts and skips
+ * every list whose letter cannot be supplied by the rack anymore, so only the paths actually made of the
+ * rack tiles are visited. Like CompletionIterator, it doesn't allocate anything.
+ *
+ *     for (AnagramIterator i(dawg, "SATIRE?", 7); i.next();) {
+ *         puts(i.word());
+ *     }
+ */
+class AnagramIterator
+{
+public:
+    static const char KBlankTile = '?';
+    static const size_t KMaxRackSize = 255;
+
+    // With useAllTiles only the words using every tile are returned. Throws std::length_error if the rack
+    // has more than KMaxRackSize tiles.
+    AnagramIterator(const Dawg &dawg, const char *rack, size_t length, bool useAllTiles = false);
+
+    // Moves to the next word. Returns false when there are no more words.
+    bool next();
+
+    // Null terminated, valid until the next call to next().
+    const char* word() const {
+        return mWord;
+    }
+
+    size_t length() const {
+        return mDepth;
+    }
+
+    // Whether the letter at given position of the word is made with a blank tile.
+    bool isBlank(size_t position) const {
+        return mUsedBlank[position];
+    }
+
+private:
+    AnagramIterator(const AnagramIterator&);
+    AnagramIterator& operator=(const AnagramIterator&);
+
+    template <class Format>
+    bool next(const typename Format::Node *nodes);
+    // Moves to the next node that can be made from the remaining tiles, in depth first order, and takes a
+    // tile for it. Returns false when there are no more such nodes.
+    template <class Format>
+    bool advance(const typename Format::Node *nodes);
+    // Moves from the node on top of the stack, whose tile is already returned, to the next node that can
+    // be made from the remaining tiles.
+    template <class Format>
+    bool skip(const typename Format::Node *nodes);
+    // Takes a tile for the node on top of the stack, preferring the tile with its letter over a blank.
+    template <class Format>
+    bool take(const typename Format::Node *nodes);
+    // Returns the tile taken for the node at given depth to the rack.
+    void release(size_t depth);
+
+    // One of them is set, like in Dawg
+    const NarrowNodeFormat::Node *mNodes;
+    const WideNodeFormat::Node *mWideNodes;
+    bool mUseAllTiles;
+    bool mStarted;
+
+    unsigned char mTiles[256];
+    size_t mBlanks;
+    size_t mTilesLeft;
+
+    // Stack of the positions of the nodes for every letter of the current word; every one of them holds
+    // a tile taken from the rack.
+    int mStack[KMaxRackSize];
+    bool mUsedBlank[KMaxRackSize];
+    size_t mDepth;
+
+    char mWord[KMaxRackSize + 1];
+};
+
+/**
+ * Streams the words within given Levenshtein distance of a query. Every node on the current path holds one
+ * row of the edit distance table between the query and the path, computed from the row of its parent, so
+ * the table is shared by all the words with a common prefix. As soon as every cell of a row exceeds the
+ * distance, the whole subgraph below the node is skipped. Nothing is allocated.
+ *
+ *     for (FuzzyIterator i(dawg, "TOPZ", 4, 1); i.next();) {
+ *         printf("%s %d\n", i.word(), (int)i.distance());
+ *     }
+ */
+class FuzzyIterator
+{
+public:
+    static const size_t KMaxQueryLength = 64;
+    static const size_t KMaxDistance = 8;
+
+    // Throws std::length_error if the query is longer than KMaxQueryLength and std::invalid_argument if
+    // the distance is larger than KMaxDistance.
+    FuzzyIterator(const Dawg &dawg, const char *query, size_t length, size_t maxDistance);
+
+    // Moves to the next word. Returns false when there are no more words.
+    bool next();
+
+    // Null terminated, valid until the next call to next().
+    const char* word() const {
+        return mWord;
+    }
+
+    size_t length() const {
+        return mDepth;
+    }
+
+    // Edit distance between the word and the query.
+    size_t distance() const {
+        return mRows[mDepth][mQueryLength];
+    }
+
+private:
+    static const size_t KMaxWordLength = KMaxQueryLength + KMaxDistance;
+
+    FuzzyIterator(const FuzzyIterator&);
+    FuzzyIterator& operator=(const FuzzyIterator&);
+
+    template <class Format>
+    bool next(const typename Format::Node *nodes);
+    // Moves to the next node, in depth first order, whose row still has a cell within the distance.
+    // Returns false when there are no more such nodes.
+    template <class Format>
+    bool advance(const typename Format::Node *nodes);
+    // Moves from the node on top of the stack to its next brother, or to the next brother of its closest
+    // ancestor, whose row still has a cell within the distance.
+    template <class Format>
+    bool skip(const typename Format::Node *nodes);
+    // Calculates the row for the node on top of the stack. Returns false if all its cells exceed the distance.
+    template <class Format>
+    bool enter(const typename Format::Node *nodes);
+
+    // One of them is set, like in Dawg
+    const NarrowNodeFormat::Node *mNodes;
+    const WideNodeFormat::Node *mWideNodes;
+    bool mStarted;
+
+    char mQuery[KMaxQueryLength];
+    size_t mQueryLength;
+    size_t mMaxDistance;
+
+    int mStack[KMaxWordLength];
+    size_t mDepth;
+
+    // mRows[i][j] is the distance between the first i letters of the word and the first j letters of the
+    // query, capped at mMaxDistance + 1.
+    unsigned char mRows[KMaxWordLength + 1][KMaxQueryLength + 1];
+
+    char mWord[KMaxWordLength + 1];
+};
+
+#endif
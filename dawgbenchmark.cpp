@@ -0,0 +1,415 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <ios>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "dawg.h"
+#include "dawgminify.h"
+#include "packeddawg.h"
+#include "layout.h"
+#include "mappedfile.h"
+#include "wordlist.h"
+
+using namespace std;
+
+namespace {
+    const char KWordListFileName[] = "Word-List.txt";
+    const char KEncodedFileName[] = "Word-List.dat";
+    const char KLayoutFileName[] = "Word-List.layout.dat";
+    const char KWidthFileName[] = "Word-List.width.dat";
+    const char KPackedFileName[] = "Word-List.packed.dat";
+
+    const int KRepetitions = 5;
+    const size_t KBatchSize = 1024;
+    const size_t KRackSize = 7;
+    const size_t KRandomNodeFetches = 1 << 22;
+}
+
+/**
+ * Query set: every word from the list, and every word with its last letter changed, which is usually a miss
+ * found only at the very end of the path. Queries are shuffled, so consecutive lookups don't share paths.
+ */
+vector<string> prepareQueries(const vector<Word> &words) {
+    vector<string> queries;
+    queries.reserve(words.size() * 2);
+    for (auto word = words.begin(); word != words.end(); ++word) {
+        queries.push_back(word->str());
+        string miss = word->str();
+        miss[miss.length() - 1] ^= 0x01;
+        queries.push_back(miss);
+    }
+
+    // Fixed seed, so every run uses the same order
+    unsigned int seed = 12345;
+    for (size_t i = queries.size(); i > 1; --i) {
+        seed = seed * 1103515245 + 12345;
+        swap(queries[i - 1], queries[(seed >> 8) % i]);
+    }
+    return queries;
+}
+
+// Returns the time of the fastest of the passes, which is the least disturbed by other processes.
+template <class Function>
+double fastestPass(Function pass) {
+    double best = 0;
+    for (int repetition = 0; repetition != KRepetitions; ++repetition) {
+        auto start = chrono::steady_clock::now();
+        pass();
+        chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+        if (repetition == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+    }
+    return best;
+}
+
+// Returns the time per query of the fastest pass over all queries.
+template <class Function>
+double nanosecondsPerQuery(const vector<string> &queries, size_t &checksum, Function query) {
+    return fastestPass([&]() {
+        for (auto i = queries.begin(); i != queries.end(); ++i) {
+            checksum += query(*i);
+        }
+    }) / queries.size();
+}
+
+// Two letter prefixes only touch the longest lists at the top of the graph, which stay in the cache, so
+// they show the cost of scanning the lists rather than the cost of cache misses.
+vector<string> preparePrefixQueries(const vector<string> &queries) {
+    vector<string> prefixes;
+    prefixes.reserve(queries.size());
+    for (auto query = queries.begin(); query != queries.end(); ++query) {
+        prefixes.push_back(query->substr(0, 2));
+    }
+    return prefixes;
+}
+
+void benchmarkScanKernels(Dawg &dawg, const vector<string> &queries, const vector<string> &prefixes) {
+    const Dawg::ScanKernel kernels[] = { Dawg::KScalarScan, Dawg::KSse2Scan, Dawg::KAvx2Scan };
+    const char *names[] = { "scalar", "SSE2", "AVX2" };
+
+    printf("Scan kernels, %d queries:\n", (int)queries.size());
+    for (int i = 0; i != 3; ++i) {
+        if (!Dawg::isSupported(kernels[i])) {
+            printf("  %-8s not supported\n", names[i]);
+            continue;
+        }
+        dawg.setScanKernel(kernels[i]);
+        size_t found = 0;
+        double wordTime = nanosecondsPerQuery(queries, found, [&dawg](const string &word) {
+            return dawg.contains(word);
+        });
+        double prefixTime = nanosecondsPerQuery(prefixes, found, [&dawg](const string &prefix) {
+            return dawg.hasPrefix(prefix);
+        });
+        printf("  %-8s contains %7.1f ns/lookup, two letter hasPrefix %6.1f ns/lookup\n", names[i], wordTime, prefixTime);
+    }
+}
+
+void benchmarkBatches(const Dawg &dawg, const vector<string> &queries) {
+    size_t found = 0;
+    double singleTime = nanosecondsPerQuery(queries, found, [&dawg](const string &word) {
+        return dawg.contains(word);
+    });
+
+    // Each pass checks the queries in consecutive batches
+    bool results[KBatchSize];
+    size_t batchFound = 0;
+    double batchTime = fastestPass([&]() {
+        for (size_t first = 0; first < queries.size(); first += KBatchSize) {
+            size_t count = min(KBatchSize, queries.size() - first);
+            dawg.contains(&queries[first], count, results);
+            batchFound += count_if(results, results + count, [](bool result) { return result; });
+        }
+    }) / queries.size();
+
+    printf("Batched lookups, %d words per batch:\n", (int)KBatchSize);
+    printf("  one by one %7.1f ns/lookup\n", singleTime);
+    printf("  batched    %7.1f ns/lookup (%.1fx)%s\n", batchTime, singleTime / batchTime,
+           batchFound == found ? "" : ", RESULTS DIFFER");
+}
+
+// Racks of seven tiles taken from the letters of the queries, every fourth of them with a blank.
+vector<string> prepareRacks(const vector<string> &queries) {
+    vector<string> racks;
+    string rack;
+    for (auto query = queries.begin(); query != queries.end() && racks.size() < queries.size() / 100; ++query) {
+        for (auto letter = query->begin(); letter != query->end(); ++letter) {
+            rack.push_back(*letter);
+            if (rack.length() == KRackSize) {
+                if (racks.size() % 4 == 0) {
+                    rack[0] = AnagramIterator::KBlankTile;
+                }
+                racks.push_back(rack);
+                rack.clear();
+            }
+        }
+    }
+    return racks;
+}
+
+void benchmarkAnagrams(const Dawg &dawg, const vector<string> &racks) {
+    size_t found = 0;
+    double time = nanosecondsPerQuery(racks, found, [&dawg](const string &rack) {
+        size_t words = 0;
+        for (AnagramIterator i(dawg, rack.data(), rack.length()); i.next();) {
+            ++words;
+        }
+        return words;
+    });
+    printf("Anagrams, %d racks of %d tiles:\n", (int)racks.size(), (int)KRackSize);
+    printf("  %7.1f us/rack, %d racks/s, %.1f words/rack\n", time / 1000, (int)(1e9 / time),
+           (double)found / KRepetitions / racks.size());
+}
+
+void benchmarkFuzzySearch(const Dawg &dawg, const vector<string> &queries) {
+    vector<string> sample;
+    for (size_t i = 0; i < queries.size(); i += 400) {
+        if (queries[i].length() <= FuzzyIterator::KMaxQueryLength) {
+            sample.push_back(queries[i]);
+        }
+    }
+
+    printf("Fuzzy search, %d queries:\n", (int)sample.size());
+    for (size_t distance = 1; distance <= 2; ++distance) {
+        size_t found = 0;
+        double time = nanosecondsPerQuery(sample, found, [&dawg, distance](const string &query) {
+            size_t words = 0;
+            for (FuzzyIterator i(dawg, query.data(), query.length(), distance); i.next();) {
+                ++words;
+            }
+            return words;
+        });
+        printf("  k=%d %8.1f us/query, %.1f words/query\n", (int)distance, time / 1000,
+               (double)found / KRepetitions / sample.size());
+    }
+}
+
+void writeBuffer(const char *fileName, const char *buffer, size_t size) {
+    ofstream output(fileName, fstream::out | fstream::binary);
+    if (!output.is_open()) {
+        throw ios_base::failure("Cannot open binary file");
+    }
+    output.write(buffer, size);
+}
+
+// Nodes of the DAWG in WideNodeFormat, without node 0, like the generator keeps them.
+vector<int64_t> encodedNodesOf(const Dawg &dawg) {
+    vector<int64_t> encodedNodes;
+    encodedNodes.reserve(dawg.nodeCount());
+    for (int position = 1; position < (int)dawg.nodeCount(); ++position) {
+        encodedNodes.push_back(dawg.wideNode(position));
+    }
+    return encodedNodes;
+}
+
+// Every layout is written to a temporary file and loaded like any other DAWG. The frequency layout is fed
+// with the queries themselves, so it shows the best case for a sample that matches the real traffic.
+void benchmarkLayouts(const Dawg &dawg, const vector<string> &queries) {
+    const NodeLayout layouts[] = { KBuilderLayout, KBreadthFirstLayout, KBlockedLayout, KFrequencyLayout };
+    const char *names[] = { "builder", "bfs", "veb", "frequency" };
+
+    vector<int64_t> encodedNodes = encodedNodesOf(dawg);
+    vector<Word> sample;
+    for (auto query = queries.begin(); query != queries.end(); ++query) {
+        sample.push_back(Word(query->data(), query->length()));
+    }
+
+    printf("Layouts:\n");
+    for (int i = 0; i != 4; ++i) {
+        vector<int64_t> arranged = layoutNodes(encodedNodes, layouts[i], sample);
+        LayoutStatistics statistics = measureLayout(arranged, sample);
+        NodeFileWriter<WideNodeFormat> writer(KLayoutFileName, arranged, NULL);
+        if (!SupportedNodeFormats::dispatchNarrowest(arranged.size() + 1, writer) || !writer.written()) {
+            throw ios_base::failure("Cannot write binary file");
+        }
+
+        size_t found = 0;
+        double time;
+        {
+            Dawg arrangedDawg(KLayoutFileName);
+            time = nanosecondsPerQuery(queries, found, [&arrangedDawg](const string &word) {
+                return arrangedDawg.contains(word);
+            });
+        }
+        unlink(KLayoutFileName);
+        printf("  %-10s %7.1f ns/lookup, %5.2f cache lines, %5.2f pages per lookup\n", names[i], time,
+               statistics.mCacheLinesPerLookup, statistics.mPagesPerLookup);
+    }
+}
+
+// The same graph with 32-bit and with 64-bit nodes. The 64-bit nodes are only written for graphs too large
+// for the 32-bit ones, and this shows what they cost.
+template <class Format>
+void benchmarkNodeFormat(const vector<int64_t> &encodedNodes, const vector<string> &queries) {
+    const int nodeBits = 8 * sizeof(typename Format::Node);
+    if (encodedNodes.size() + 1 > Format::KMaxNodeCount) {
+        printf("  %d-bit   too many nodes\n", nodeBits);
+        return;
+    }
+    if (!writeNodeFile<Format, WideNodeFormat>(KWidthFileName, encodedNodes, NULL)) {
+        throw ios_base::failure("Cannot write binary file");
+    }
+
+    size_t found = 0;
+    size_t batchFound = 0;
+    double time;
+    double batchTime;
+    {
+        Dawg widthDawg(KWidthFileName);
+        time = nanosecondsPerQuery(queries, found, [&widthDawg](const string &word) {
+            return widthDawg.contains(word);
+        });
+        bool results[KBatchSize];
+        batchTime = fastestPass([&]() {
+            for (size_t first = 0; first < queries.size(); first += KBatchSize) {
+                size_t count = min(KBatchSize, queries.size() - first);
+                widthDawg.contains(&queries[first], count, results);
+                batchFound += count_if(results, results + count, [](bool result) { return result; });
+            }
+        }) / queries.size();
+    }
+    unlink(KWidthFileName);
+    printf("  %d-bit   contains %7.1f ns/lookup, batched %7.1f ns/lookup, %d MB%s\n", nodeBits, time, batchTime,
+           (int)(encodedNodes.size() * sizeof(typename Format::Node) >> 20), found == batchFound ? "" : ", RESULTS DIFFER");
+}
+
+void benchmarkNodeWidths(const Dawg &dawg, const vector<string> &queries) {
+    vector<int64_t> encodedNodes = encodedNodesOf(dawg);
+
+    printf("Node widths:\n");
+    benchmarkNodeFormat<NarrowNodeFormat>(encodedNodes, queries);
+    benchmarkNodeFormat<WideNodeFormat>(encodedNodes, queries);
+}
+
+// Throughput of every codec kernel for the bit-packed format from dawgminify, counted in bytes of unpacked
+// nodes. Random fetches read nodes at random indices, so each one pays for the unaligned load, the shift
+// and the mask. Lookups in the packed DAWG are compared with the same lookups in the unpacked nodes.
+void benchmarkPackedNodes(const char *fileName, const Dawg &dawg, const vector<string> &queries) {
+    MappedFile file(fileName);
+    size_t nodeBytes = dawg.nodeCount() * (dawg.hasWideNodes() ? BYTES_PER_WIDE_NODE : BYTES_PER_NODE);
+    const void *nodes = dawg.hasWideNodes() ? static_cast<const void*>(dawg.wideNodes()) : dawg.nodes();
+
+    // The output of the scalar kernel is the reference for the others
+    size_t encodedSize = 0;
+    char *encoded = encode_with(CODEC_SCALAR, file.data(), file.size(), &encodedSize);
+    if (encoded == NULL) {
+        throw ios_base::failure("Cannot encode binary file");
+    }
+    packed_dawg packed;
+    packed_open(&packed, encoded, encodedSize);
+    printf("Packed nodes, %d letters, %d bits/node, %d bytes (%.1f%% of %d):\n", packed.alphabet_size,
+           packed.bits_per_node, (int)encodedSize, 100.0 * encodedSize / nodeBytes, (int)nodeBytes);
+
+    const codec_kernel kernels[] = { CODEC_SCALAR, CODEC_BMI2, CODEC_AVX2 };
+    const char *names[] = { "scalar", "BMI2", "AVX2" };
+    for (int i = 0; i != 3; ++i) {
+        if (!codec_supported(kernels[i])) {
+            printf("  %-8s not supported\n", names[i]);
+            continue;
+        }
+
+        char *kernelEncoded = NULL;
+        size_t kernelEncodedSize = 0;
+        double encodeTime = fastestPass([&]() {
+            free(kernelEncoded);
+            kernelEncoded = encode_with(kernels[i], file.data(), file.size(), &kernelEncodedSize);
+        });
+        char *decoded = NULL;
+        size_t decodedSize = 0;
+        double decodeTime = fastestPass([&]() {
+            free(decoded);
+            decoded = decode_with(kernels[i], encoded, encodedSize, &decodedSize);
+        });
+        dawg_header header;
+        bool same = kernelEncodedSize == encodedSize && memcmp(kernelEncoded, encoded, encodedSize) == 0 &&
+                    dawg_read_header(&header, decoded, decodedSize) &&
+                    memcmp(decoded + dawg_find_section(&header, DAWG_SECTION_NODES)->offset, nodes, nodeBytes) == 0;
+        printf("  %-8s encode %6.2f GB/s, decode %6.2f GB/s%s\n", names[i], nodeBytes / encodeTime,
+               nodeBytes / decodeTime, same ? "" : ", RESULTS DIFFER");
+        free(kernelEncoded);
+        free(decoded);
+    }
+
+    vector<uint32_t> indices(KRandomNodeFetches);
+    unsigned int seed = 12345;
+    for (auto index = indices.begin(); index != indices.end(); ++index) {
+        seed = seed * 1103515245 + 12345;
+        *index = (seed >> 4) % packed.nbr_nodes;
+    }
+    size_t wordNodes = 0;
+    double fetchTime = fastestPass([&]() {
+        for (auto index = indices.begin(); index != indices.end(); ++index) {
+            wordNodes += (packed_node(&packed, *index) & packed.word_flag) != 0;
+        }
+    });
+
+    printf("  random fetch %5.1f ns/node, %.1f%% end of word nodes\n", fetchTime / indices.size(),
+           100.0 * wordNodes / KRepetitions / indices.size());
+
+    writeBuffer(KPackedFileName, encoded, encodedSize);
+    free(encoded);
+
+    size_t found = 0;
+    double unpackedTime = nanosecondsPerQuery(queries, found, [&dawg](const string &word) {
+        return dawg.contains(word);
+    });
+    size_t packedFound = 0;
+    double packedTime;
+    {
+        PackedDawg packedDawg(KPackedFileName);
+        packedTime = nanosecondsPerQuery(queries, packedFound, [&packedDawg](const string &word) {
+            return packedDawg.contains(word);
+        });
+    }
+    unlink(KPackedFileName);
+    printf("  contains %7.1f ns/lookup packed, %7.1f ns/lookup unpacked%s\n", packedTime, unpackedTime,
+           packedFound == found ? "" : ", RESULTS DIFFER");
+}
+
+// Measures the query library on Word-List.dat built from Word-List.txt in the current directory.
+int main() {
+    try {
+        WordList wordList(KWordListFileName);
+        Dawg dawg(KEncodedFileName);
+        printf("%d words, %d nodes\n", (int)wordList.words().size(), (int)dawg.nodeCount());
+
+        vector<string> queries = prepareQueries(wordList.words());
+        benchmarkScanKernels(dawg, queries, preparePrefixQueries(queries));
+        benchmarkBatches(dawg, queries);
+        benchmarkAnagrams(dawg, prepareRacks(queries));
+        benchmarkFuzzySearch(dawg, queries);
+        benchmarkLayouts(dawg, queries);
+        benchmarkNodeWidths(dawg, queries);
+        benchmarkPackedNodes(KEncodedFileName, dawg, queries);
+    } catch (exception &e) {
+        printf("%s\n", e.what());
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,364 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "dawgformat.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void put_u16(unsigned char* out, uint16_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void put_u32(unsigned char* out, uint32_t value)
+{
+    put_u16(out, value & 0xFFFF);
+    put_u16(out + 2, value >> 16);
+}
+
+static void put_u64(unsigned char* out, uint64_t value)
+{
+    put_u32(out, value & 0xFFFFFFFF);
+    put_u32(out + 4, value >> 32);
+}
+
+static uint16_t get_u16(const unsigned char* in)
+{
+    return in[0] | (in[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char* in)
+{
+    return get_u16(in) | ((uint32_t)get_u16(in + 2) << 16);
+}
+
+static uint64_t get_u64(const unsigned char* in)
+{
+    return get_u32(in) | ((uint64_t)get_u32(in + 4) << 32);
+}
+
+static uint8_t host_byte_order(void)
+{
+    const uint16_t probe = 1;
+    return *(const unsigned char*) &probe == 1 ? DAWG_LITTLE_ENDIAN : DAWG_BIG_ENDIAN;
+}
+
+static uint64_t align_section(uint64_t offset)
+{
+    return (offset + DAWG_SECTION_ALIGNMENT - 1) / DAWG_SECTION_ALIGNMENT * DAWG_SECTION_ALIGNMENT;
+}
+
+/**
+    dawg_header_init
+    
+    Fills the header with no sections and no node layout, for the byte order of this host.
+    
+    header          the header to fill
+    node_format     one of DAWG_FORMAT_*
+    node_count      number of nodes, including the empty node 0
+    
+*/
+void dawg_header_init(dawg_header* header, uint8_t node_format, uint64_t node_count)
+{
+    memset(header, 0, sizeof(*header));
+    header->version = DAWG_VERSION;
+    header->node_format = node_format;
+    header->node_count = node_count;
+    header->byte_order = host_byte_order();
+}
+
+/**
+    dawg_header_init_words
+    
+    Fills the header for 32-bit or 64-bit nodes, with no sections.
+    
+    header          the header to fill
+    node_count      number of nodes, including the empty node 0
+    node_size       4 or 8 bytes
+    
+*/
+void dawg_header_init_words(dawg_header* header, uint64_t node_count, int node_size)
+{
+    dawg_header_init(header, DAWG_FORMAT_WORDS, node_count);
+    header->bits_per_node = node_size * 8;
+    header->letter_bits = DAWG32_LETTER_BITS;
+    header->letter_shift = 0;
+    header->index_bits = node_size == 8 ? DAWG64_INDEX_BITS : DAWG32_INDEX_BITS;
+    header->index_shift = node_size == 8 ? DAWG64_INDEX_SHIFT : DAWG32_INDEX_SHIFT;
+    header->end_of_word_bit = DAWG32_END_OF_WORD_BIT;
+    header->end_of_list_bit = DAWG32_END_OF_LIST_BIT;
+}
+
+/**
+    dawg_words_node_size
+    
+    Returns 4 or 8 if the header describes the 32-bit or the 64-bit nodes set by dawg_header_init_words,
+    and 0 otherwise.
+    
+*/
+int dawg_words_node_size(const dawg_header* header)
+{
+    int node_size = header->bits_per_node / 8;
+    dawg_header words;
+    if ( node_size != 4 && node_size != 8 )
+    {
+        return 0;
+    }
+    dawg_header_init_words(&words, header->node_count, node_size);
+    int same = header->node_format == words.node_format && header->bits_per_node == words.bits_per_node &&
+               header->letter_bits == words.letter_bits && header->letter_shift == words.letter_shift &&
+               header->index_bits == words.index_bits && header->index_shift == words.index_shift &&
+               header->end_of_word_bit == words.end_of_word_bit && header->end_of_list_bit == words.end_of_list_bit &&
+               header->alphabet_size == 0;
+    return same ? node_size : 0;
+}
+
+/**
+    dawg_node_size_for
+    
+    Returns the size of the narrowest nodes whose index can address given number of nodes, 4 or 8 bytes,
+    or 0 if there are too many nodes even for the 64-bit nodes.
+    
+    node_count      number of nodes, including the empty node 0
+    
+*/
+int dawg_node_size_for(uint64_t node_count)
+{
+    if ( node_count <= DAWG32_MAX_NODE_COUNT )
+    {
+        return 4;
+    }
+    return node_count <= DAWG64_MAX_NODE_COUNT ? 8 : 0;
+}
+
+/**
+    dawg_add_section
+    
+    Appends a section to the directory. Its offset is set by dawg_layout_sections.
+    
+*/
+void dawg_add_section(dawg_header* header, uint32_t type, uint64_t size)
+{
+    assert(header->section_count < DAWG_MAX_SECTIONS);
+    dawg_section* section = &header->sections[header->section_count++];
+    section->type = type;
+    section->offset = 0;
+    section->size = size;
+}
+
+/**
+    dawg_prefix_size
+    
+    Returns the size of the header and the directory, padded to the first section.
+    
+*/
+uint64_t dawg_prefix_size(const dawg_header* header)
+{
+    return align_section(DAWG_HEADER_SIZE + (uint64_t)header->section_count * DAWG_DIRECTORY_ENTRY_SIZE);
+}
+
+/**
+    dawg_layout_sections
+    
+    Places the sections one after another in the order they were added. Returns the size of the file.
+    
+*/
+uint64_t dawg_layout_sections(dawg_header* header)
+{
+    int i;
+    uint64_t offset = dawg_prefix_size(header);
+    for ( i = 0; i < header->section_count; i++ )
+    {
+        offset = align_section(offset);
+        header->sections[i].offset = offset;
+        offset += header->sections[i].size;
+    }
+    return offset;
+}
+
+/**
+    dawg_write_prefix
+    
+    Writes the header and the directory.
+    
+    header          the header, after dawg_layout_sections
+    out             dawg_prefix_size(header) bytes to write to
+    
+*/
+void dawg_write_prefix(const dawg_header* header, unsigned char* out)
+{
+    int i;
+    memset(out, 0, dawg_prefix_size(header));
+    memcpy(out, DAWG_MAGIC, 4);
+    put_u16(out + 4, header->version);
+    put_u16(out + 6, DAWG_HEADER_SIZE);
+    put_u64(out + 8, header->node_count);
+    out[16] = header->node_format;
+    out[17] = header->bits_per_node;
+    out[18] = header->letter_bits;
+    out[19] = header->letter_shift;
+    out[20] = header->index_bits;
+    out[21] = header->index_shift;
+    out[22] = header->end_of_word_bit;
+    out[23] = header->end_of_list_bit;
+    put_u16(out + 24, header->alphabet_size);
+    put_u16(out + 26, header->section_count);
+    out[28] = header->byte_order;
+    put_u64(out + 32, DAWG_HEADER_SIZE);
+    
+    for ( i = 0; i < header->section_count; i++ )
+    {
+        unsigned char* entry = out + DAWG_HEADER_SIZE + i * DAWG_DIRECTORY_ENTRY_SIZE;
+        put_u32(entry, header->sections[i].type);
+        put_u64(entry + 8, header->sections[i].offset);
+        put_u64(entry + 16, header->sections[i].size);
+    }
+}
+
+/**
+    dawg_read_header
+    
+    Reads and validates the header and the directory. Returns 0 if the buffer doesn't start with a header
+    of a supported version, if it has native nodes of the other byte order than this host's, or if any
+    section lies outside the buffer or isn't aligned.
+    
+    header          the header to fill
+    in              contents of the file
+    size            size of the file
+    
+*/
+int dawg_read_header(dawg_header* header, const void* in, size_t size)
+{
+    int i;
+    const unsigned char* bytes = (const unsigned char*) in;
+    
+    if ( size < DAWG_HEADER_SIZE || memcmp(bytes, DAWG_MAGIC, 4) != 0 )
+    {
+        return 0;
+    }
+    
+    dawg_header_init(header, bytes[16], get_u64(bytes + 8));
+    header->version = get_u16(bytes + 4);
+    header->bits_per_node = bytes[17];
+    header->letter_bits = bytes[18];
+    header->letter_shift = bytes[19];
+    header->index_bits = bytes[20];
+    header->index_shift = bytes[21];
+    header->end_of_word_bit = bytes[22];
+    header->end_of_list_bit = bytes[23];
+    header->alphabet_size = get_u16(bytes + 24);
+    header->section_count = get_u16(bytes + 26);
+    header->byte_order = bytes[28];
+    uint64_t directory = get_u64(bytes + 32);
+    
+    if ( header->version < 1 || header->version > DAWG_VERSION || get_u16(bytes + 6) < DAWG_HEADER_SIZE ||
+         header->section_count > DAWG_MAX_SECTIONS || header->letter_bits > 8 || header->alphabet_size > 256 ||
+         header->bits_per_node > 64 || directory > size ||
+         (header->node_format == DAWG_FORMAT_WORDS && header->byte_order != host_byte_order()) ||
+         size - directory < (uint64_t)header->section_count * DAWG_DIRECTORY_ENTRY_SIZE )
+    {
+        return 0;
+    }
+    
+    for ( i = 0; i < header->section_count; i++ )
+    {
+        const unsigned char* entry = bytes + directory + i * DAWG_DIRECTORY_ENTRY_SIZE;
+        dawg_section* section = &header->sections[i];
+        section->type = get_u32(entry);
+        section->offset = get_u64(entry + 8);
+        section->size = get_u64(entry + 16);
+        if ( section->offset % DAWG_SECTION_ALIGNMENT != 0 || section->offset > size ||
+             section->size > size - section->offset )
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+    dawg_find_section
+    
+    Returns the section of given type, or NULL if the file doesn't have it.
+    
+*/
+const dawg_section* dawg_find_section(const dawg_header* header, uint32_t type)
+{
+    int i;
+    for ( i = 0; i < header->section_count; i++ )
+    {
+        if ( header->sections[i].type == type )
+        {
+            return &header->sections[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+    dawg_write_file
+    
+    Writes a file with 32-bit or 64-bit nodes. Returns 0 if the file cannot be written.
+    
+    filename        the file to write
+    nodes_header    header of the nodes, with no sections yet, see dawg_header_init_words
+    nodes           node_count nodes of the header, native endian, starting with the empty node 0
+    word_counts     NULL, or node_count word counts for the word counts section
+    
+*/
+int dawg_write_file(const char* filename, const dawg_header* nodes_header, const void* nodes,
+                    const uint32_t* word_counts)
+{
+    dawg_header header = *nodes_header;
+    uint64_t node_count = header.node_count;
+    int node_size = header.bits_per_node / 8;
+    dawg_add_section(&header, DAWG_SECTION_NODES, node_count * node_size);
+    if ( word_counts != NULL )
+    {
+        dawg_add_section(&header, DAWG_SECTION_WORD_COUNTS, node_count * sizeof(uint32_t));
+    }
+    dawg_layout_sections(&header);
+    
+    unsigned char* prefix = (unsigned char*) malloc(dawg_prefix_size(&header));
+    if ( prefix == NULL )
+    {
+        return 0;
+    }
+    dawg_write_prefix(&header, prefix);
+    
+    FILE* fp = fopen(filename, "wb");
+    int ok = fp != NULL &&
+             fwrite(prefix, dawg_prefix_size(&header), 1, fp) == 1 &&
+             fwrite(nodes, node_size, node_count, fp) == node_count;
+    if ( ok && word_counts != NULL )
+    {
+        // Zeros up to the aligned start of the section
+        static const unsigned char padding[DAWG_SECTION_ALIGNMENT];
+        const dawg_section* counts = &header.sections[1];
+        uint64_t written = header.sections[0].offset + header.sections[0].size;
+        ok = fwrite(padding, 1, counts->offset - written, fp) == counts->offset - written &&
+             fwrite(word_counts, sizeof(uint32_t), node_count, fp) == node_count;
+    }
+    if ( fp != NULL && fclose(fp) != 0 )
+    {
+        ok = 0;
+    }
+    free(prefix);
+    return ok;
+}
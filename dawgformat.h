@@ -0,0 +1,131 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DAWGFORMAT_H
+#define DAWGFORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Every DAWG file starts with a 64 byte header, followed by the section directory and the sections. The
+ * numbers of the header and the directory are little-endian and every section starts at a multiple of
+ * DAWG_SECTION_ALIGNMENT bytes. The nodes and the word counts of DAWG_FORMAT_WORDS are native ints, so that
+ * they can be mapped and queried directly; they are in the byte order of the host which wrote the file,
+ * recorded in the header, and dawg_read_header rejects them on a host of the other byte order. The packed
+ * nodes are a little-endian bit stream on every host.
+ *
+ *  0  "DAWG"
+ *  4  u16 version
+ *  6  u16 header size
+ *  8  u64 number of nodes, including the empty node 0
+ * 16  u8  node format, DAWG_FORMAT_*
+ * 17  u8  bits per node
+ * 18  u8  letter bits          19  u8  letter shift
+ * 20  u8  index bits           21  u8  index shift
+ * 22  u8  End-Of-Word bit      23  u8  End-Of-Children-List bit
+ * 24  u16 alphabet size, 0 if the letters are stored as they are
+ * 26  u16 number of sections
+ * 28  u8  byte order of DAWG_FORMAT_WORDS sections, DAWG_*_ENDIAN
+ * 32  u64 offset of the section directory
+ *
+ * A directory entry takes DAWG_DIRECTORY_ENTRY_SIZE bytes: u32 section type, u32 reserved, u64 offset and
+ * u64 size of the section. The alphabet section lists the letters in the order of their codes; a node
+ * stores the code of its letter instead of the letter itself.
+ */
+#define DAWG_MAGIC			"DAWG"
+#define DAWG_VERSION			(1)
+#define DAWG_HEADER_SIZE		(64)
+#define DAWG_DIRECTORY_ENTRY_SIZE	(24)
+#define DAWG_SECTION_ALIGNMENT		(64)
+#define DAWG_MAX_SECTIONS		(8)
+
+#define DAWG_FORMAT_WORDS		(1)	/* one native 32 or 64-bit int per node, mapped and queried directly */
+#define DAWG_FORMAT_PACKED		(2)	/* bits_per_node bits per node, see dawgminify.h */
+
+#define DAWG_LITTLE_ENDIAN		(1)
+#define DAWG_BIG_ENDIAN			(2)
+
+#define DAWG_SECTION_ALPHABET		(1)
+#define DAWG_SECTION_NODES		(2)
+#define DAWG_SECTION_WORD_COUNTS	(3)
+
+/* Layout of the 32-bit nodes of DAWG_FORMAT_WORDS, NarrowNodeFormat in nodeformat.h */
+#define DAWG32_LETTER_BITS		(8)
+#define DAWG32_INDEX_SHIFT		(8)
+#define DAWG32_INDEX_BITS		(20)
+#define DAWG32_END_OF_LIST_BIT		(28)
+#define DAWG32_END_OF_WORD_BIT		(29)
+#define DAWG32_MAX_NODE_COUNT		((uint64_t)1 << DAWG32_INDEX_BITS)
+
+/*
+ * Layout of the 64-bit nodes of DAWG_FORMAT_WORDS, for graphs with more nodes than DAWG32_MAX_NODE_COUNT.
+ * The letter and the flags are in the same bits as in the 32-bit nodes and the index takes the upper half.
+ * The readers address nodes with signed 32-bit ints, which limits the node count. WideNodeFormat in
+ * nodeformat.h.
+ */
+#define DAWG64_INDEX_SHIFT		(32)
+#define DAWG64_INDEX_BITS		(32)
+#define DAWG64_MAX_NODE_COUNT		((uint64_t)0x7FFFFFFF)
+
+typedef struct
+{
+    uint32_t type;
+    uint64_t offset;
+    uint64_t size;
+} dawg_section;
+
+typedef struct
+{
+    uint16_t version;
+    uint64_t node_count;
+    uint8_t node_format;
+    uint8_t bits_per_node;
+    uint8_t letter_bits;
+    uint8_t letter_shift;
+    uint8_t index_bits;
+    uint8_t index_shift;
+    uint8_t end_of_word_bit;
+    uint8_t end_of_list_bit;
+    uint16_t alphabet_size;
+    uint16_t section_count;
+    uint8_t byte_order;
+    dawg_section sections[DAWG_MAX_SECTIONS];
+} dawg_header;
+
+void dawg_header_init(dawg_header* header, uint8_t node_format, uint64_t node_count);
+void dawg_header_init_words(dawg_header* header, uint64_t node_count, int node_size);
+int dawg_words_node_size(const dawg_header* header);
+int dawg_node_size_for(uint64_t node_count);
+void dawg_add_section(dawg_header* header, uint32_t type, uint64_t size);
+uint64_t dawg_layout_sections(dawg_header* header);
+uint64_t dawg_prefix_size(const dawg_header* header);
+void dawg_write_prefix(const dawg_header* header, unsigned char* out);
+int dawg_read_header(dawg_header* header, const void* in, size_t size);
+const dawg_section* dawg_find_section(const dawg_header* header, uint32_t type);
+int dawg_write_file(const char* filename, const dawg_header* nodes_header, const void* nodes,
+                    const uint32_t* word_counts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
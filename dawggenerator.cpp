@@ -15,230 +15,522 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cctype>
 #include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cstdlib>
 #include <cassert>
 #include <vector>
 #include <algorithm>
 #include <list>
-#include <set>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <fstream>
 #include <stdexcept>
 #include <array>
 
 #include "polarssl/sha1.h"
+#include "dawg.h"
+#include "externalsort.h"
+#include "layout.h"
+#include "packeddawg.h"
+#include "taskpool.h"
+#include "wordlist.h"
 
 using namespace std;
 
 namespace {
     const char KWordListFileName[] = "Word-List.txt";
     const char KEncodedFileName[] = "Word-List.dat";
-
-    const int KChildBitShift = 8;
-    const int KChildIndexMask = 0x0FFFFF00;
-    const int KLetterMask = 0x000000FF;
-    const int KEndOfWordFlag = 0x20000000;
-    const int KEndOfListFlag = 0x10000000;
+    const char KPackedFileName[] = "Word-List.packed";
+    const char KEmbeddedFileName[] = "Word-List.h";
+    const char KBoundsTestFileName[] = "Word-List.bounds.dat";
+    const char KPackedBoundsTestFileName[] = "Word-List.bounds.packed";
 
     const size_t KHashSize = 20;
+
+    // Returns the position of the next node in the encoded file, after node 0 and the nodes placed so far.
+    // Throws std::length_error if not even the 64-bit nodes can address it.
+    int nextPosition(size_t placedNodes) {
+        if (placedNodes + 1 >= WideNodeFormat::KMaxNodeCount) {
+            throw length_error("Graph has too many nodes for the DAWG file");
+        }
+        return placedNodes + 1;
+    }
 }
 
 typedef array<unsigned char, KHashSize> Hash;
 
-class GraphNode;
-typedef set<GraphNode*, bool(*)(const GraphNode*, const GraphNode*)> UniqueNodeSet;
+/**
+ * Node signatures used to find identical nodes. Signature type has to provide calculate() for a block
+ * of bytes, equality and raw data() of KSize (at least 16) bytes. KMayCollide tells whether nodes with equal
+ * signatures still have to be compared directly before one replaces the other.
+ */
+class Sha1Signature
+{
+public:
+    static const bool KMayCollide = false;
 
-class GraphNode
+    static Sha1Signature calculate(const unsigned char *input, size_t length) {
+        Sha1Signature result;
+        sha1(input, length, result.mDigest.data());
+        return result;
+    }
+
+    bool operator==(const Sha1Signature &other) const {
+        return memcmp(mDigest.data(), other.mDigest.data(), KHashSize) == 0;
+    }
+
+    const unsigned char* data() const {
+        return mDigest.data();
+    }
+
+    static const size_t KSize = KHashSize;
+
+private:
+    Hash mDigest;
+};
+
+/**
+ * 128-bit wyhash-style signature: every 16 bytes of input are folded into two 64-bit lanes with a
+ * 64x64->128 bit multiplication. Much cheaper than SHA-1, but collisions are possible in theory.
+ */
+class FastSignature
+{
+public:
+    static const bool KMayCollide = true;
+
+    static FastSignature calculate(const unsigned char *input, size_t length) {
+        uint64_t low = KSecret[0] ^ length;
+        uint64_t high = KSecret[1] + length;
+
+        for (; length >= 16; input += 16, length -= 16) {
+            uint64_t first = read64(input);
+            uint64_t second = read64(input + 8);
+            low = mix(first ^ KSecret[2], second ^ low);
+            high = mix(second ^ KSecret[3], first ^ high);
+        }
+
+        if (length != 0) {
+            unsigned char tail[16] = { 0 };
+            memcpy(tail, input, length);
+            uint64_t first = read64(tail);
+            uint64_t second = read64(tail + 8);
+            low = mix(first ^ KSecret[2], second ^ low);
+            high = mix(second ^ KSecret[3], first ^ high);
+        }
+
+        FastSignature result;
+        result.mWords[0] = mix(low ^ KSecret[4], high ^ KSecret[5]);
+        result.mWords[1] = mix(high ^ KSecret[6], low ^ KSecret[7]);
+        return result;
+    }
+
+    bool operator==(const FastSignature &other) const {
+        return mWords[0] == other.mWords[0] && mWords[1] == other.mWords[1];
+    }
+
+    const unsigned char* data() const {
+        return reinterpret_cast<const unsigned char*>(mWords);
+    }
+
+    static const size_t KSize = sizeof(uint64_t) * 2;
+
+private:
+    static uint64_t read64(const unsigned char *input) {
+        uint64_t result;
+        memcpy(&result, input, sizeof(result));
+        return result;
+    }
+
+    static uint64_t mix(uint64_t one, uint64_t other) {
+        __uint128_t product = (__uint128_t)one * other;
+        return (uint64_t)product ^ (uint64_t)(product >> 64);
+    }
+
+    static const uint64_t KSecret[8];
+
+    uint64_t mWords[2];
+};
+
+const uint64_t FastSignature::KSecret[8] = {
+    0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL,
+    0x1d8e4e27c47d124fULL, 0x9e3779b97f4a7c15ULL, 0xbf58476d1ce4e5b9ULL, 0x94d049bb133111ebULL
+};
+
+typedef unsigned int NodeId;
+
+namespace {
+    const NodeId KRootNode = 0;
+    const NodeId KNoNode = 0xFFFFFFFF;
+    const unsigned int KNoLink = 0xFFFFFFFF;
+    const unsigned int KNoMember = 0xFFFFFFFF;
+    const unsigned int KNoClass = 0xFFFFFFFF;
+
+    // Lists with fewer nodes below them are hashed by the task which found them
+    const unsigned int KMinHashTaskSize = 4096;
+}
+
+/**
+ * Trie node used while the words are being added. Children form a singly linked list of node ids, newest
+ * child first, so adding a child doesn't require moving anything around.
+ */
+struct TrieNode
+{
+    TrieNode(unsigned char value, int depthGroup) :
+        mFirstChild(KNoNode),
+        mNextSibling(KNoNode),
+        mDepthGroup(depthGroup),
+        mValue(value),
+        mEndOfWord(false)
+    {
+    }
+
+    NodeId mFirstChild;
+    NodeId mNextSibling;
+    int mDepthGroup;
+    unsigned char mValue;
+    bool mEndOfWord;
+};
+
+class Trie
 {
+public:
+    Trie() {
+        mNodes.push_back(TrieNode(' ', -1));
+    }
+
+    NodeId findChild(NodeId node, unsigned char childValue) const {
+        for (NodeId i = mNodes[node].mFirstChild; i != KNoNode; i = mNodes[i].mNextSibling) {
+            if (mNodes[i].mValue == childValue) {
+                return i;
+            }
+        }
+        return KNoNode;
+    }
+
+    NodeId addChild(NodeId node, unsigned char childValue, int depthGroup) {
+        NodeId newChild = mNodes.size();
+        mNodes.push_back(TrieNode(childValue, depthGroup));
+        mNodes[newChild].mNextSibling = mNodes[node].mFirstChild;
+        mNodes[node].mFirstChild = newChild;
+        return newChild;
+    }
 
+public:
+    vector<TrieNode> mNodes;
+};
+
+class GraphNode
+{
 public:
     GraphNode() :
-        mEndOfWord(false),
-        mValue(' '),
+        mFirstChild(KNoNode),
+        mParentLinks(KNoLink),
+        mLastParentLink(KNoLink),
+        mReferences(0),
         mDepthGroup(-1),
+        mDawgIndex(-1),
+        mValue(' '),
+        mEndOfWord(false),
         mIsDirectChild(true),
-        mEndOfDawgList(false),
-        mDawgIndex(-1)
+        mEndOfDawgList(false)
     {
     }
 
 public:
-    vector<GraphNode*> mParents;
-    vector<GraphNode*> mChildren;
-    bool mEndOfWord;
-    unsigned char mValue;
+    // Children have consecutive ids, starting from mFirstChild up to the node with mEndOfDawgList set.
+    NodeId mFirstChild;
+    unsigned int mParentLinks;
+    unsigned int mLastParentLink;
+    // Number of live parents with this node on their children list. Node is removed from the graph when
+    // it drops to zero.
+    unsigned int mReferences;
     int mDepthGroup;
+    int mDawgIndex;
+    unsigned char mValue;
+    bool mEndOfWord;
     bool mIsDirectChild;
-
     bool mEndOfDawgList;
-    int mDawgIndex;
-
-    Hash mSha1;
-
-    GraphNode(unsigned char childValue, int depthGroup, GraphNode *parent) :
-        mEndOfWord(false),
-        mValue(childValue),
-        mDepthGroup(depthGroup),
-        mIsDirectChild(false),
-        mEndOfDawgList(false),
-        mDawgIndex(-1)
-    {
-        mParents.push_back(parent);
-    }
+};
 
+/**
+ * Arena holding all graph nodes. Nodes are addressed by 32-bit ids and the children of every node occupy
+ * a continuous range of ids, exactly like in the final encoding. Because of that replacing a node with its
+ * twin only needs to point the parents at the twin's range, and no node is ever moved or freed until the
+ * whole graph goes away.
+ *
+ * Parents are kept as linked lists in a single flat array. Every node starts with one link to its trie
+ * parent, and the lists are only ever spliced together, so the array never grows.
+ */
+class Graph
+{
 public:
-    static bool compareByHashThenDirect(const GraphNode* one, const GraphNode* other) {
-        int hashCompare = memcmp(one->mSha1.data(), other->mSha1.data(), KHashSize);
-        if (hashCompare == 0) {
-            if (one->mIsDirectChild == other->mIsDirectChild) {
-                return one < other;
-            } else {
-                return one->mIsDirectChild < other->mIsDirectChild;
+    // Lays out the trie nodes level by level, so the children of every node get consecutive ids. Child
+    // order is the order in which the children were added to the trie.
+    explicit Graph(const Trie &trie) :
+        mNodes(trie.mNodes.size()),
+        mParentLinks(trie.mNodes.size())
+    {
+        vector<NodeId> trieIds;
+        trieIds.reserve(trie.mNodes.size());
+        trieIds.push_back(KRootNode);
+
+        // Root doesn't have any brothers and it's always a part of the graph.
+        mNodes[KRootNode].mEndOfDawgList = true;
+        mNodes[KRootNode].mReferences = 1;
+
+        vector<NodeId> children;
+        NodeId nextFreeId = 1;
+        for (NodeId id = 0; id != trieIds.size(); ++id) {
+            const TrieNode &trieNode = trie.mNodes[trieIds[id]];
+            GraphNode &node = mNodes[id];
+            node.mValue = trieNode.mValue;
+            node.mEndOfWord = trieNode.mEndOfWord;
+            node.mDepthGroup = trieNode.mDepthGroup;
+
+            children.clear();
+            for (NodeId i = trieNode.mFirstChild; i != KNoNode; i = trie.mNodes[i].mNextSibling) {
+                children.push_back(i);
+            }
+            if (children.empty()) {
+                continue;
             }
-        } else {
-            return hashCompare < 0;
-        }
-    }
 
-    ~GraphNode() {
-        if (mIsDirectChild) {
-            for (auto i = mChildren.begin(); i != mChildren.end(); ++i) {
-                delete *i;
+            node.mFirstChild = nextFreeId;
+            for (auto child = children.rbegin(); child != children.rend(); ++child, ++nextFreeId) {
+                trieIds.push_back(*child);
+                mNodes[nextFreeId].mIsDirectChild = false;
+                mNodes[nextFreeId].mReferences = 1;
+                mParentLinks[nextFreeId].mParent = id;
+                mParentLinks[nextFreeId].mNext = KNoLink;
+                mNodes[nextFreeId].mParentLinks = nextFreeId;
+                mNodes[nextFreeId].mLastParentLink = nextFreeId;
             }
+            mNodes[node.mFirstChild].mIsDirectChild = true;
+            mNodes[nextFreeId - 1].mEndOfDawgList = true;
         }
+
+        groupByDepth();
     }
 
-    void calculateHash(const vector<unsigned char> &brothersHash = vector<unsigned char>()) {
-        vector<unsigned char> hashInput;
+    GraphNode& operator[](NodeId id) {
+        return mNodes[id];
+    }
 
-        // We're iterating through children backwards, so the intermediate values of
-        // hashInput are in fact brothersHash of successive children.
-        for (auto i = mChildren.rbegin(); i != mChildren.rend(); ++i) {
-            (*i)->calculateHash(hashInput);
-            hashInput.insert(hashInput.end(), (*i)->mSha1.cbegin(), (*i)->mSha1.cend());
-        }
+    const GraphNode& operator[](NodeId id) const {
+        return mNodes[id];
+    }
 
-        hashInput.push_back(mValue);
-        hashInput.push_back(mEndOfWord);
-        hashInput.insert(hashInput.end(), brothersHash.cbegin(), brothersHash.cend());
+    NodeId size() const {
+        return mNodes.size();
+    }
 
-        sha1(&hashInput[0], hashInput.size(), mSha1.data());
+    NodeId lastInList(NodeId id) const {
+        while (!mNodes[id].mEndOfDawgList) {
+            ++id;
+        }
+        return id;
     }
 
-    void indexNodes(vector<GraphNode*> &indexedNodes) {
-        if (!mChildren.empty() && mChildren.front()->mIsDirectChild && mChildren.front()->mDawgIndex == -1) {
-            for (auto i = mChildren.begin(); i != mChildren.end(); ++i) {
-                (*i)->mDawgIndex = indexedNodes.size() + 1;
-                indexedNodes.push_back(*i);
+    void indexNodes(vector<NodeId> &indexedNodes, NodeId id = KRootNode) {
+        NodeId firstChild = mNodes[id].mFirstChild;
+        if (firstChild != KNoNode && mNodes[firstChild].mIsDirectChild && mNodes[firstChild].mDawgIndex == -1) {
+            NodeId lastChild = lastInList(firstChild);
+            for (NodeId child = firstChild; child <= lastChild; ++child) {
+                mNodes[child].mDawgIndex = nextPosition(indexedNodes.size());
+                indexedNodes.push_back(child);
             }
 
-            for (auto i = mChildren.begin(); i != mChildren.end(); ++i) {
-                (*i)->indexNodes(indexedNodes);
+            for (NodeId child = firstChild; child <= lastChild; ++child) {
+                indexNodes(indexedNodes, child);
             }
         }
     }
 
-    void markFirstAndLastChild() {
-        if (!mChildren.empty()) {
+    // Adds the nodes from given depth group that are still a part of the graph to the result, in order of ids.
+    void findNodesAtDepth(const int depth, vector<NodeId> &result) {
+        if (depth < 0 || depth >= (int)mDepthGroupBegin.size()) {
+            return;
+        }
+
+        // Drop the nodes removed since the group was created
+        auto begin = mNodesByDepth.begin() + mDepthGroupBegin[depth];
+        auto end = mNodesByDepth.begin() + mDepthGroupEnd[depth];
+        end = remove_if(begin, end, IsRemoved(this));
+        mDepthGroupEnd[depth] = end - mNodesByDepth.begin();
 
-            mChildren.front()->mIsDirectChild = true;
-            mChildren.back()->mEndOfDawgList = true;
+        result.insert(result.end(), begin, end);
+    }
 
-            for (auto i = mChildren.begin(); i != mChildren.end(); ++i) {
-                (*i)->markFirstAndLastChild();
+    // Compares the node and its further brothers with the other node and its brothers, including the whole
+    // subgraphs below them.
+    bool haveSameStructure(NodeId one, NodeId other) const {
+        for (;; ++one, ++other) {
+            if (one == other) {
+                return true;
+            }
+
+            const GraphNode &oneNode = mNodes[one];
+            const GraphNode &otherNode = mNodes[other];
+            if (oneNode.mValue != otherNode.mValue ||
+                oneNode.mEndOfWord != otherNode.mEndOfWord ||
+                oneNode.mEndOfDawgList != otherNode.mEndOfDawgList) {
+                return false;
+            }
+
+            if (oneNode.mFirstChild == KNoNode || otherNode.mFirstChild == KNoNode) {
+                if (oneNode.mFirstChild != otherNode.mFirstChild) {
+                    return false;
+                }
+            } else if (!haveSameStructure(oneNode.mFirstChild, otherNode.mFirstChild)) {
+                return false;
+            }
+
+            if (oneNode.mEndOfDawgList) {
+                return true;
             }
         }
     }
 
-    void findNodesAtDepth(const int depth, UniqueNodeSet &result) {
-        for (auto i = mChildren.begin(); i != mChildren.end(); ++i) {
-            if (depth <= (*i)->mDepthGroup) {
-                if (depth == (*i)->mDepthGroup) {
-                    result.insert(*i);
+    // Points all parents of the node and its further brothers to the corresponding nodes in the list
+    // of replacement node.
+    void replaceWith(NodeId oldNode, NodeId newNode) {
+        NodeId oldLast = lastInList(oldNode);
+        NodeId listLength = oldLast - oldNode + 1;
+        assert(lastInList(newNode) - newNode + 1 == listLength);
+
+        for (NodeId i = listLength; i-- != 0;) {
+            NodeId oldChild = oldNode + i;
+            NodeId newChild = newNode + i;
+            for (unsigned int link = mNodes[oldChild].mParentLinks; link != KNoLink; link = mParentLinks[link].mNext) {
+                GraphNode &parent = mNodes[mParentLinks[link].mParent];
+                if (parent.mFirstChild == oldChild) {
+                    parent.mFirstChild = newChild;
+                    if (parent.mReferences != 0) {
+                        for (NodeId child = newChild; child != newNode + listLength; ++child) {
+                            ++mNodes[child].mReferences;
+                        }
+                    }
                 }
-                (*i)->findNodesAtDepth(depth, result);
             }
+            moveParents(oldChild, newChild);
+        }
+
+        // Nobody points at the old list anymore
+        for (NodeId oldChild = oldNode; oldChild <= oldLast; ++oldChild) {
+            mNodes[oldChild].mReferences = 0;
+            releaseChildren(oldChild);
         }
     }
 
-    bool haveSameHashAs(GraphNode *other) {
-        assert(other != this);
-        return memcmp(mSha1.data(), other->mSha1.data(), KHashSize) == 0;
+    bool isRemoved(NodeId id) const {
+        return mNodes[id].mReferences == 0;
     }
 
-    vector<GraphNode*> getNextNodes() {
-        assert(!mParents.empty());
-        const vector<GraphNode*> &brothers = (*mParents.begin())->mChildren;
-        return vector<GraphNode*>(find(brothers.begin(), brothers.end(), this), brothers.end());
+    // The node in WideNodeFormat, see encodeGraph().
+    int64_t encoded(NodeId id) const {
+        const GraphNode &node = mNodes[id];
+        assert(node.mDawgIndex != -1);
+        int firstChild = node.mFirstChild == KNoNode ? 0 : mNodes[node.mFirstChild].mDawgIndex;
+        assert(firstChild != -1);
+        return WideNodeFormat::encode(node.mValue, firstChild, node.mEndOfWord, node.mEndOfDawgList);
     }
 
-    void replaceWith(GraphNode* node, UniqueNodeSet &depthGroup) {
-        auto oldChildren = getNextNodes();
-        auto newChildren = node->getNextNodes();
-        assert(oldChildren.size() == newChildren.size());
+private:
+    struct ParentLink {
+        NodeId mParent;
+        unsigned int mNext;
+    };
 
-        auto newChild = newChildren.end() - 1;
-        for (auto oldChild = oldChildren.rbegin(); oldChild != oldChildren.rend(); ++oldChild, --newChild) {
-            for (auto parent = (*oldChild)->mParents.begin(); parent != (*oldChild)->mParents.end(); ++parent) {
-                (*newChild)->mParents.push_back(*parent);
+    class IsRemoved
+    {
+    public:
+        explicit IsRemoved(const Graph *graph) : mGraph(graph) {}
 
-                if ((*parent)->mChildren.front() == *oldChild) {
-                    (*parent)->mChildren = vector<GraphNode*>(newChild, newChildren.end());
-                }
-            }
+        bool operator()(NodeId id) const {
+            return mGraph->isRemoved(id);
         }
 
-        while (oldChildren.size() > 1) {
-            depthGroup.erase(oldChildren.back());
-            oldChildren.pop_back();
+    private:
+        const Graph *mGraph;
+    };
+
+    // Sorts the node ids by the depth group, so every depth pass of reduceGraph gets its nodes without
+    // walking the graph.
+    void groupByDepth() {
+        int maxDepthGroup = -1;
+        for (auto node = mNodes.begin(); node != mNodes.end(); ++node) {
+            maxDepthGroup = max(maxDepthGroup, node->mDepthGroup);
         }
-    }
 
-    int encoded() {
-        assert(mDawgIndex != -1);
-        int result = mChildren.empty() ? 0 : mChildren.front()->mDawgIndex;
-        assert(result != -1);
-        result <<= KChildBitShift;
-        result += mValue;
-        if (mEndOfWord) result += KEndOfWordFlag;
-        if (mEndOfDawgList) result += KEndOfListFlag;
-        return result;
-    }
+        vector<size_t> groupSize(maxDepthGroup + 1, 0);
+        for (auto node = mNodes.begin(); node != mNodes.end(); ++node) {
+            if (node->mDepthGroup >= 0) {
+                ++groupSize[node->mDepthGroup];
+            }
+        }
 
-    GraphNode* findChild(unsigned char childValue) {
-        for (auto i = mChildren.begin(); i != mChildren.end(); ++i) {
-            if ((*i)->mValue == childValue) {
-                return (*i);
+        mDepthGroupBegin.resize(maxDepthGroup + 1);
+        mDepthGroupEnd.resize(maxDepthGroup + 1);
+        size_t offset = 0;
+        for (int depth = 0; depth <= maxDepthGroup; ++depth) {
+            mDepthGroupBegin[depth] = mDepthGroupEnd[depth] = offset;
+            offset += groupSize[depth];
+        }
+
+        mNodesByDepth.resize(offset);
+        for (NodeId id = 0; id != mNodes.size(); ++id) {
+            int depth = mNodes[id].mDepthGroup;
+            if (depth >= 0) {
+                mNodesByDepth[mDepthGroupEnd[depth]++] = id;
             }
         }
-        return NULL;
     }
 
-    GraphNode* addChild(unsigned char childValue, int depthGroup) {
-        GraphNode* newChild = new GraphNode(childValue, depthGroup, this);
-        mChildren.push_back(newChild);
-        return newChild;
+    // Removes one reference from every child of the node, removing the children that are no longer used
+    // together with their own children.
+    void releaseChildren(NodeId id) {
+        NodeId firstChild = mNodes[id].mFirstChild;
+        if (firstChild == KNoNode) {
+            return;
+        }
+        for (NodeId child = firstChild, lastChild = lastInList(firstChild); child <= lastChild; ++child) {
+            if (--mNodes[child].mReferences == 0) {
+                releaseChildren(child);
+            }
+        }
     }
-};
 
-vector<string> readWordList() {
-    vector<string> output;
-    string word;
-    ifstream input(KWordListFileName);
-    if (!input.is_open()) {
-        throw ios_base::failure("Cannot open word list");
-    }
-    while (input.good()) {
-        input >> word;
-        if (input.good()) {
-            output.push_back(word);
+    void moveParents(NodeId from, NodeId to) {
+        GraphNode &source = mNodes[from];
+        GraphNode &target = mNodes[to];
+        if (source.mParentLinks == KNoLink) {
+            return;
+        }
+        if (target.mParentLinks == KNoLink) {
+            target.mParentLinks = source.mParentLinks;
+        } else {
+            mParentLinks[target.mLastParentLink].mNext = source.mParentLinks;
         }
+        target.mLastParentLink = source.mLastParentLink;
+        source.mParentLinks = KNoLink;
+        source.mLastParentLink = KNoLink;
     }
-    input.close();
-    return output;
-}
 
-bool sortByLengthThenAlphabetically(const string &one, const string &other) {
+    vector<GraphNode> mNodes;
+    vector<ParentLink> mParentLinks;
+
+    vector<NodeId> mNodesByDepth;
+    vector<size_t> mDepthGroupBegin;
+    vector<size_t> mDepthGroupEnd;
+};
+
+template <class WordType>
+bool sortByLengthThenAlphabetically(const WordType &one, const WordType &other) {
     if (one.length() == other.length()) {
         return one.compare(other) < 0;
     } else {
@@ -250,8 +542,7 @@ template <class Iter>
 Hash calculateWordListChecksum(Iter first, Iter last) {
     Hash result;
     if (last - first == 1) {
-        string word = *first;
-        sha1((unsigned char*)word.c_str(), word.length(), result.data());
+        sha1((const unsigned char*)first->data(), first->length(), result.data());
     } else {
         array<unsigned char, KHashSize * 2> mergedHashes;
 
@@ -266,157 +557,1164 @@ Hash calculateWordListChecksum(Iter first, Iter last) {
     return result;
 }
 
-void buildTrie(const vector<string> &words, GraphNode &rootNode) {
+/**
+ * Signatures of all graph nodes. Nodes have identical signatures if and only if they have the same letter,
+ * End-Of-Word flag, children and further brothers (modulo collisions of Signature).
+ */
+template <class Signature>
+class NodeSignatures
+{
+public:
+    explicit NodeSignatures(Graph &graph) :
+        mGraph(graph),
+        mSignatures(graph.size())
+    {
+    }
+
+    const Signature& operator[](NodeId id) const {
+        return mSignatures[id];
+    }
+
+    // Signature of a node combines its letter and End-Of-Word flag with the signature of its first child, which
+    // covers all the children, and the signature of its next brother, which covers all the further brothers.
+    // Children and brothers have higher ids than the node itself (see Graph constructor), so a single pass
+    // from the last node to the first one calculates everything.
+    void calculateHash() {
+        for (NodeId id = mGraph.size(); id-- != 0;) {
+            mSignatures[id] = combine(id);
+        }
+    }
+
+    // Same as above, but the lists with large subgraphs below them are hashed as separate tasks. The list
+    // of brothers is hashed once the tasks for all their children lists are finished, so the result is
+    // identical to the single threaded one.
+    void calculateHash(TaskPool &pool) {
+        if (pool.threadCount() == 1) {
+            calculateHash();
+            return;
+        }
+
+        // Number of nodes in the list starting at given node and in all subgraphs below it.
+        vector<unsigned int> subgraphSize(mGraph.size());
+        for (NodeId id = mGraph.size(); id-- != 0;) {
+            const GraphNode &node = mGraph[id];
+            subgraphSize[id] = 1;
+            if (node.mFirstChild != KNoNode) {
+                subgraphSize[id] += subgraphSize[node.mFirstChild];
+            }
+            if (!node.mEndOfDawgList) {
+                subgraphSize[id] += subgraphSize[id + 1];
+            }
+        }
+
+        NodeId firstChild = mGraph[KRootNode].mFirstChild;
+        if (firstChild != KNoNode) {
+            hashList(firstChild, pool, subgraphSize);
+        }
+        mSignatures[KRootNode] = combine(KRootNode);
+    }
+
+    // Checks whether the nodes with the same signature can really be merged.
+    bool areIdentical(NodeId one, NodeId other) const {
+        return !Signature::KMayCollide || mGraph.haveSameStructure(one, other);
+    }
+
+private:
+    void hashList(NodeId first, TaskPool &pool, const vector<unsigned int> &subgraphSize) {
+        NodeId last = mGraph.lastInList(first);
+
+        TaskPool::TaskGroup children;
+        for (NodeId id = first; id <= last; ++id) {
+            NodeId firstChild = mGraph[id].mFirstChild;
+            if (firstChild == KNoNode) {
+                continue;
+            }
+            if (subgraphSize[firstChild] >= KMinHashTaskSize) {
+                pool.spawn(children, [this, firstChild, &pool, &subgraphSize] {
+                    hashList(firstChild, pool, subgraphSize);
+                });
+            } else {
+                hashList(firstChild, pool, subgraphSize);
+            }
+        }
+        pool.wait(children);
+
+        for (NodeId id = last + 1; id-- != first;) {
+            mSignatures[id] = combine(id);
+        }
+    }
+
+    Signature combine(NodeId id) const {
+        array<unsigned char, 3 + 2 * Signature::KSize> hashInput;
+        const GraphNode &node = mGraph[id];
+
+        hashInput[0] = node.mValue;
+        hashInput[1] = node.mEndOfWord;
+        hashInput[2] = 0;
+
+        unsigned char *childHash = &hashInput[3];
+        if (node.mFirstChild != KNoNode) {
+            hashInput[2] |= 1;
+            memcpy(childHash, mSignatures[node.mFirstChild].data(), Signature::KSize);
+        } else {
+            memset(childHash, 0, Signature::KSize);
+        }
+
+        unsigned char *brotherHash = childHash + Signature::KSize;
+        if (!node.mEndOfDawgList) {
+            hashInput[2] |= 2;
+            memcpy(brotherHash, mSignatures[id + 1].data(), Signature::KSize);
+        } else {
+            memset(brotherHash, 0, Signature::KSize);
+        }
+
+        return Signature::calculate(hashInput.data(), hashInput.size());
+    }
+
+    Graph &mGraph;
+    vector<Signature> mSignatures;
+};
+
+void buildTrie(const vector<Word> &words, Trie &trie) {
     for (auto word = words.crbegin(); word != words.crend(); ++word) {
         int currentDepth = word->length() - 1;
-        GraphNode* currentNode = &rootNode;
+        NodeId currentNode = KRootNode;
 
         for (auto letter = word->begin(); letter != word->end(); ++letter) {
-            GraphNode* nextNode = currentNode->findChild(*letter);
-            if (nextNode == NULL) {
-                GraphNode* newNode = currentNode->addChild(*letter, currentDepth);
+            NodeId nextNode = trie.findChild(currentNode, *letter);
+            if (nextNode == KNoNode) {
+                NodeId newNode = trie.addChild(currentNode, *letter, currentDepth);
                 currentNode = newNode;
             } else {
                 currentNode = nextNode;
             }
             --currentDepth;
         }
-        currentNode->mEndOfWord = true;
+        trie.mNodes[currentNode].mEndOfWord = true;
     }
 }
 
-void reduceGraph(GraphNode &rootNode, int maxNodeDepth) {
+/**
+ * Open addressing hash table grouping the nodes of one depth group into classes of identical nodes, i.e.
+ * nodes with the same signature which also pass NodeSignatures::areIdentical(). Classes are kept in order
+ * of their first node and the nodes of every class in order of addition. The table and the node lists
+ * are reused for every depth group, so once the largest group is processed nothing is allocated anymore.
+ *
+ * The signatures can be split between several registers with partitionOf(). Nodes from different
+ * partitions are never identical, so the registers can be filled in parallel.
+ */
+template <class Signature>
+class NodeRegister
+{
+public:
+    explicit NodeRegister(const NodeSignatures<Signature> &signatures) :
+        mSignatures(signatures),
+        mMask(0)
+    {
+    }
+
+    static unsigned int partitionOf(const Signature &signature, unsigned int partitionCount) {
+        // Different bits than the ones used by slotFor(), so every partition uses its whole table
+        uint64_t hash;
+        memcpy(&hash, signature.data() + sizeof(hash), sizeof(hash));
+        return hash % partitionCount;
+    }
+
+    void reset(size_t expectedNodeCount) {
+        size_t tableSize = 16;
+        while (tableSize < expectedNodeCount * 2) {
+            tableSize <<= 1;
+        }
+        mSlots.assign(tableSize, KNoClass);
+        mMask = tableSize - 1;
+
+        mMembers.clear();
+        mMembers.reserve(expectedNodeCount);
+        mNextMember.clear();
+        mNextMember.reserve(expectedNodeCount);
+        mClasses.clear();
+    }
+
+    void add(NodeId node) {
+        if (mClasses.size() * 2 >= mSlots.size()) {
+            grow();
+        }
+
+        const Signature &signature = mSignatures[node];
+        size_t slot = slotFor(signature);
+        while (mSlots[slot] != KNoClass) {
+            NodeId classNode = firstNode(mSlots[slot]);
+            if (mSignatures[classNode] == signature && mSignatures.areIdentical(classNode, node)) {
+                break;
+            }
+            slot = (slot + 1) & mMask;
+        }
+
+        unsigned int member = mMembers.size();
+        mMembers.push_back(node);
+        mNextMember.push_back(KNoMember);
+
+        if (mSlots[slot] == KNoClass) {
+            mSlots[slot] = mClasses.size();
+            EquivalenceClass newClass = { member, member };
+            mClasses.push_back(newClass);
+        } else {
+            EquivalenceClass &existingClass = mClasses[mSlots[slot]];
+            mNextMember[existingClass.mLastMember] = member;
+            existingClass.mLastMember = member;
+        }
+    }
+
+    size_t classCount() const {
+        return mClasses.size();
+    }
+
+    NodeId firstNode(size_t classIndex) const {
+        return mMembers[mClasses[classIndex].mFirstMember];
+    }
+
+    unsigned int firstMember(size_t classIndex) const {
+        return mClasses[classIndex].mFirstMember;
+    }
+
+    unsigned int nextMember(unsigned int member) const {
+        return mNextMember[member];
+    }
+
+    NodeId node(unsigned int member) const {
+        return mMembers[member];
+    }
+
+private:
+    struct EquivalenceClass {
+        unsigned int mFirstMember;
+        unsigned int mLastMember;
+    };
+
+    size_t slotFor(const Signature &signature) const {
+        uint64_t hash;
+        memcpy(&hash, signature.data(), sizeof(hash));
+        return (hash ^ (hash >> 29)) & mMask;
+    }
+
+    // Only needed when a partition gets much more than its share of the depth group
+    void grow() {
+        mSlots.assign(mSlots.size() * 2, KNoClass);
+        mMask = mSlots.size() - 1;
+        for (unsigned int classIndex = 0; classIndex != mClasses.size(); ++classIndex) {
+            size_t slot = slotFor(mSignatures[firstNode(classIndex)]);
+            while (mSlots[slot] != KNoClass) {
+                slot = (slot + 1) & mMask;
+            }
+            mSlots[slot] = classIndex;
+        }
+    }
+
+    const NodeSignatures<Signature> &mSignatures;
+    vector<unsigned int> mSlots;
+    size_t mMask;
+
+    vector<NodeId> mMembers;
+    vector<unsigned int> mNextMember;
+    vector<EquivalenceClass> mClasses;
+};
+
+// Replaces all replaceable nodes from the class with a single node of that class.
+template <class Signature>
+void mergeClass(Graph &graph, const NodeRegister<Signature> &uniqueNodes, size_t nodeClass) {
+    // Only the direct children can be replaced, so the replacement is the first node that is not a direct
+    // child, or the first node if they all are. Some nodes of the class might have been removed together
+    // with their brothers while handling the previous classes.
+    NodeId replacement = KNoNode;
+    for (unsigned int member = uniqueNodes.firstMember(nodeClass); member != KNoMember; member = uniqueNodes.nextMember(member)) {
+        NodeId node = uniqueNodes.node(member);
+        if (graph.isRemoved(node)) {
+            continue;
+        }
+        if (replacement == KNoNode || (graph[replacement].mIsDirectChild && !graph[node].mIsDirectChild)) {
+            replacement = node;
+        }
+    }
+
+    if (replacement == KNoNode) {
+        return;
+    }
+
+    for (unsigned int member = uniqueNodes.firstMember(nodeClass); member != KNoMember; member = uniqueNodes.nextMember(member)) {
+        NodeId node = uniqueNodes.node(member);
+        if (node != replacement && !graph.isRemoved(node) && graph[node].mIsDirectChild) {
+            graph.replaceWith(node, replacement);
+        }
+    }
+}
+
+/**
+ * Removes the redundant nodes depth group by depth group. Each depth pass has two phases:
+ *
+ * 1. The nodes are grouped into classes of identical nodes. The signatures are split into one partition per
+ *    thread, and every thread fills the register of its own partition, so all hash lookups and direct node
+ *    comparisons run in parallel on the unchanged graph.
+ * 2. The classes are merged one by one, in order of their first node. Lists of nodes from different classes
+ *    can overlap (a replaced list contains the nodes of other classes), so rewiring the parents is done on
+ *    a single thread; the fixed order makes the result identical for any number of threads.
+ */
+template <class Signature>
+void reduceGraph(Graph &graph, const NodeSignatures<Signature> &signatures, int maxNodeDepth, TaskPool &pool) {
+    typedef NodeRegister<Signature> UniqueNodes;
+
+    const unsigned int partitionCount = pool.threadCount();
+    vector<UniqueNodes> partitions(partitionCount, UniqueNodes(signatures));
+    vector<pair<NodeId, pair<unsigned int, unsigned int> > > classOrder;
+    vector<NodeId> depthGroup;
+    // Nodes of the depth group in every partition, in the order of the depth group
+    vector<vector<NodeId> > partitionNodes(partitionCount);
+
     for (int currentDepth = maxNodeDepth; currentDepth >= 0; --currentDepth) {
         printf("Depth %2d: ", currentDepth);
 
-        UniqueNodeSet uniqueNodes(GraphNode::compareByHashThenDirect);
-        rootNode.findNodesAtDepth(currentDepth, uniqueNodes);
+        depthGroup.clear();
+        graph.findNodesAtDepth(currentDepth, depthGroup);
 
-        printf("%d nodes\n", uniqueNodes.size());
+        printf("%d nodes\n", (int)depthGroup.size());
 
-        if (uniqueNodes.size() > 1) {
-            for (auto node = uniqueNodes.begin(), nextNode = node; node != uniqueNodes.end(); node = nextNode) {
-                ++nextNode;
+        if (depthGroup.size() < 2) {
+            continue;
+        }
 
-                // skip until nextNode points to a node that can be replaced by the node: a direct child with
-                // identical hash as node.
-                if ((*node)->mIsDirectChild == false) {
-                    while (nextNode != uniqueNodes.end() && (*nextNode)->haveSameHashAs(*node) && (*nextNode)->mIsDirectChild == false) {
-                        ++nextNode;
-                    }
-                }
+        if (partitionCount == 1) {
+            partitionNodes[0].swap(depthGroup);
+        } else {
+            for (unsigned int partition = 0; partition != partitionCount; ++partition) {
+                partitionNodes[partition].clear();
+            }
+            for (auto node = depthGroup.cbegin(); node != depthGroup.cend(); ++node) {
+                partitionNodes[UniqueNodes::partitionOf(signatures[*node], partitionCount)].push_back(*node);
+            }
+        }
 
-                // there might be multiple nodes that can be replaced with node. Replace them all in loop and update nextNode to point
-                // at the node after replaced node
-                while (nextNode != uniqueNodes.end() && (*nextNode)->haveSameHashAs(*node)) {
-                    (*nextNode)->replaceWith(*node, uniqueNodes);
-                    uniqueNodes.erase(nextNode++);
+        pool.parallelFor(0, partitionCount, 1, [&](size_t begin, size_t end) {
+            for (size_t partition = begin; partition != end; ++partition) {
+                UniqueNodes &uniqueNodes = partitions[partition];
+                const vector<NodeId> &nodes = partitionNodes[partition];
+                uniqueNodes.reset(nodes.size() + 1);
+                for (auto node = nodes.cbegin(); node != nodes.cend(); ++node) {
+                    uniqueNodes.add(*node);
                 }
             }
+        });
+
+        classOrder.clear();
+        for (unsigned int partition = 0; partition != partitionCount; ++partition) {
+            const UniqueNodes &uniqueNodes = partitions[partition];
+            for (unsigned int nodeClass = 0; nodeClass != uniqueNodes.classCount(); ++nodeClass) {
+                classOrder.push_back(make_pair(uniqueNodes.firstNode(nodeClass), make_pair(partition, nodeClass)));
+            }
+        }
+        sort(classOrder.begin(), classOrder.end());
+
+        for (auto i = classOrder.cbegin(); i != classOrder.cend(); ++i) {
+            mergeClass(graph, partitions[i->second.first], i->second.second);
         }
     }
 }
 
+/**
+ * Builds the reduced graph directly from lexicographically sorted words, without creating the trie first
+ * (see Daciuk et al., "Incremental Construction of Minimal Acyclic Finite-State Automata").
+ *
+ * Only the states on the path of the last added word are kept unminimized. When the next word diverges from
+ * that path, the states below the common prefix cannot change anymore, so they are either replaced with
+ * an identical state from the register or added to it. The memory usage is proportional to the size of
+ * the minimal graph instead of the size of the trie.
+ *
+ * The minimal automaton has one state per unique set of outgoing edges. In the encoded graph every edge is
+ * a node and every state is a list of consecutive nodes, so the lists are laid out in encode(), sharing
+ * the tails of longer lists whenever possible, just like reduceGraph() does.
+ */
+class IncrementalDawgBuilder
+{
+public:
+    IncrementalDawgBuilder() :
+        mRegister(0, StateHash(this), StateEqual(this)),
+        mPath(1)
+    {
+    }
 
-void encodeGraph(const vector<GraphNode*> &indexedNodes) {
-    ofstream output(KEncodedFileName, fstream::out | fstream::binary);
-    if (!output.is_open()) {
-        throw ios_base::failure("Cannot open binary file");
+    void addWord(const Word &word) {
+        int compareResult = word.compare(mPreviousWord);
+        if (compareResult == 0) {
+            return;
+        } else if (compareResult < 0) {
+            throw invalid_argument("Word list is not sorted: " + word.str() + " follows " + mPreviousWord.str());
+        }
+
+        size_t commonPrefix = 0;
+        while (commonPrefix < mPreviousWord.length() && mPreviousWord[commonPrefix] == word[commonPrefix]) {
+            ++commonPrefix;
+        }
+        minimizePath(commonPrefix);
+
+        if (mPath.size() < word.length() + 1) {
+            mPath.resize(word.length() + 1);
+        }
+        for (size_t i = commonPrefix; i != word.length(); ++i) {
+            Edge edge = { static_cast<unsigned char>(word[i]), KPendingState };
+            mPath[i].mEdges.push_back(edge);
+        }
+        mPath[word.length()].mEndOfWord = true;
+
+        mPreviousWord = word;
     }
 
-    int numberOfNodes = indexedNodes.size() + 1;
-    output.write(reinterpret_cast<char*>(&numberOfNodes), sizeof(int));
+    // The nodes in WideNodeFormat, see encodeGraph().
+    vector<int64_t> encode() {
+        minimizePath(0);
+        unsigned int rootState = freeze(mPath[0]);
+
+        printf("Minimal graph has %d states and %d edges\n", (int)mStates.size(), (int)mEdges.size());
+
+        // The root list has to be the first one, because the reader starts at index 1. Then the longest
+        // lists go first, so the shorter ones have a chance to be found as their tails.
+        vector<unsigned int> stateOrder;
+        for (unsigned int state = 0; state != mStates.size(); ++state) {
+            if (state != rootState && mStates[state].mEdgeCount != 0) {
+                stateOrder.push_back(state);
+            }
+        }
+        sort(stateOrder.begin(), stateOrder.end(), ByDescendingEdgeCount(this));
+        stateOrder.insert(stateOrder.begin(), rootState);
+
+        // Chain is a node together with all its brothers further on the list. The chains are identified
+        // by the edge and the id of the next chain, and chainPosition holds the index of the node which
+        // starts the chain in the encoded graph.
+        unordered_map<ChainKey, unsigned int, ChainKeyHash> chains;
+        vector<int> chainPosition;
+        vector<int> listPosition(mStates.size(), 0);
+        vector<PlacedNode> placedNodes;
+
+        for (auto state = stateOrder.begin(); state != stateOrder.end(); ++state) {
+            const State &current = mStates[*state];
+            const Edge *edges = &mEdges[current.mFirstEdge];
+
+            unsigned int chain = KNoChain;
+            bool alreadyPlaced = true;
+            for (int i = current.mEdgeCount - 1; i >= 0 && alreadyPlaced; --i) {
+                auto found = chains.find(ChainKey(edges[i], chain));
+                if (found == chains.end()) {
+                    alreadyPlaced = false;
+                } else {
+                    chain = found->second;
+                }
+            }
+
+            if (alreadyPlaced) {
+                listPosition[*state] = chainPosition[chain];
+                continue;
+            }
 
-    int emptyZeroNode = 0;
-    output.write(reinterpret_cast<char*>(&emptyZeroNode), sizeof(int));
+            int position = nextPosition(placedNodes.size());
+            listPosition[*state] = position;
 
+            chain = KNoChain;
+            for (int i = current.mEdgeCount - 1; i >= 0; --i) {
+                auto inserted = chains.insert(make_pair(ChainKey(edges[i], chain), (unsigned int)chainPosition.size()));
+                if (inserted.second) {
+                    chainPosition.push_back(position + i);
+                }
+                chain = inserted.first->second;
+            }
+
+            for (unsigned int i = 0; i != current.mEdgeCount; ++i) {
+                PlacedNode node = { edges[i], i + 1 == current.mEdgeCount };
+                placedNodes.push_back(node);
+            }
+        }
+
+        vector<int64_t> encodedNodes;
+        encodedNodes.reserve(placedNodes.size());
+        for (auto i = placedNodes.begin(); i != placedNodes.end(); ++i) {
+            encodedNodes.push_back(WideNodeFormat::encode(i->mEdge.mLetter, listPosition[i->mEdge.mTarget],
+                                                          mStates[i->mEdge.mTarget].mEndOfWord, i->mEndOfList));
+        }
+        return encodedNodes;
+    }
+
+private:
+    static const unsigned int KPendingState = 0xFFFFFFFF;
+    static const unsigned int KNoChain = 0xFFFFFFFF;
+
+    struct Edge {
+        unsigned char mLetter;
+        unsigned int mTarget;
+    };
+
+    struct State {
+        unsigned int mFirstEdge;
+        unsigned int mEdgeCount;
+        bool mEndOfWord;
+    };
+
+    struct PathState {
+        PathState() : mEndOfWord(false) {}
+
+        bool mEndOfWord;
+        vector<Edge> mEdges;
+    };
+
+    struct PlacedNode {
+        Edge mEdge;
+        bool mEndOfList;
+    };
+
+    struct ChainKey {
+        ChainKey(const Edge &edge, unsigned int nextChain) :
+            mLetter(edge.mLetter),
+            mTarget(edge.mTarget),
+            mNextChain(nextChain)
+        {
+        }
+
+        bool operator==(const ChainKey &other) const {
+            return mLetter == other.mLetter && mTarget == other.mTarget && mNextChain == other.mNextChain;
+        }
+
+        unsigned char mLetter;
+        unsigned int mTarget;
+        unsigned int mNextChain;
+    };
+
+    struct ChainKeyHash {
+        size_t operator()(const ChainKey &key) const {
+            size_t result = key.mTarget;
+            result = result * 1000003 + key.mNextChain;
+            return result * 31 + key.mLetter;
+        }
+    };
+
+    struct StateHash {
+        explicit StateHash(const IncrementalDawgBuilder *builder) : mBuilder(builder) {}
+
+        size_t operator()(unsigned int state) const {
+            const State &current = mBuilder->mStates[state];
+            size_t result = current.mEndOfWord;
+            for (unsigned int i = current.mFirstEdge; i != current.mFirstEdge + current.mEdgeCount; ++i) {
+                const Edge &edge = mBuilder->mEdges[i];
+                result = (result * 31 + edge.mLetter) * 1000003 + edge.mTarget;
+            }
+            return result;
+        }
+
+        const IncrementalDawgBuilder *mBuilder;
+    };
+
+    struct StateEqual {
+        explicit StateEqual(const IncrementalDawgBuilder *builder) : mBuilder(builder) {}
+
+        bool operator()(unsigned int one, unsigned int other) const {
+            const State &first = mBuilder->mStates[one];
+            const State &second = mBuilder->mStates[other];
+            if (first.mEndOfWord != second.mEndOfWord || first.mEdgeCount != second.mEdgeCount) {
+                return false;
+            }
+            for (unsigned int i = 0; i != first.mEdgeCount; ++i) {
+                const Edge &firstEdge = mBuilder->mEdges[first.mFirstEdge + i];
+                const Edge &secondEdge = mBuilder->mEdges[second.mFirstEdge + i];
+                if (firstEdge.mLetter != secondEdge.mLetter || firstEdge.mTarget != secondEdge.mTarget) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        const IncrementalDawgBuilder *mBuilder;
+    };
+
+    struct ByDescendingEdgeCount {
+        explicit ByDescendingEdgeCount(const IncrementalDawgBuilder *builder) : mBuilder(builder) {}
+
+        bool operator()(unsigned int one, unsigned int other) const {
+            unsigned int oneCount = mBuilder->mStates[one].mEdgeCount;
+            unsigned int otherCount = mBuilder->mStates[other].mEdgeCount;
+            return oneCount == otherCount ? one < other : oneCount > otherCount;
+        }
+
+        const IncrementalDawgBuilder *mBuilder;
+    };
+
+    // Replaces the path states below given depth with their registered equivalents.
+    void minimizePath(size_t depth) {
+        for (size_t i = mPreviousWord.length(); i > depth; --i) {
+            mPath[i - 1].mEdges.back().mTarget = freeze(mPath[i]);
+        }
+    }
+
+    // Returns the registered state identical to the given path state, registering it if there is none,
+    // and resets the path state for reuse.
+    unsigned int freeze(PathState &pathState) {
+        State candidate = { (unsigned int)mEdges.size(), (unsigned int)pathState.mEdges.size(), pathState.mEndOfWord };
+        mEdges.insert(mEdges.end(), pathState.mEdges.begin(), pathState.mEdges.end());
+        mStates.push_back(candidate);
+
+        auto inserted = mRegister.insert(mStates.size() - 1);
+        if (!inserted.second) {
+            mEdges.resize(candidate.mFirstEdge);
+            mStates.pop_back();
+        }
+
+        pathState.mEdges.clear();
+        pathState.mEndOfWord = false;
+        return *inserted.first;
+    }
+
+    vector<State> mStates;
+    vector<Edge> mEdges;
+    unordered_set<unsigned int, StateHash, StateEqual> mRegister;
+
+    vector<PathState> mPath;
+    // Has to stay valid until the graph is encoded
+    Word mPreviousWord;
+};
+
+vector<int64_t> buildIncrementally(vector<Word> &words) {
+    printf("Sorting word list lexicographically\n");
+    sort(words.begin(), words.end());
+
+    printf("Building minimal graph\n");
+    IncrementalDawgBuilder builder;
+    for (auto word = words.cbegin(); word != words.cend(); ++word) {
+        builder.addWord(*word);
+    }
+
+    printf("Preparing final node list\n");
+    return builder.encode();
+}
+
+template <class Signature>
+vector<int64_t> buildByReduction(const vector<Word> &words, int maxWordLength, TaskPool &pool) {
+    printf("Creating a trie\n");
+    Trie trie;
+    buildTrie(words, trie);
+
+    // The trie is not needed once its nodes are copied to the graph.
+    Graph graph(trie);
+    trie = Trie();
+
+    printf("Calculating hash for all nodes\n");
+    NodeSignatures<Signature> signatures(graph);
+    signatures.calculateHash(pool);
+
+    printf("Removing redundant nodes\n");
+    reduceGraph(graph, signatures, maxWordLength - 1, pool);
+
+    printf("Preparing final node list\n");
+    vector<NodeId> indexedNodes;
+    graph.indexNodes(indexedNodes);
+
+    vector<int64_t> encodedNodes;
+    encodedNodes.reserve(indexedNodes.size());
     for (auto i = indexedNodes.begin(); i != indexedNodes.end(); ++i) {
-        int encoded = (*i)->encoded();
-        output.write(reinterpret_cast<char*>(&encoded), sizeof(int));
+        encodedNodes.push_back(graph.encoded(*i));
+    }
+    return encodedNodes;
+}
+
+// Counts the words going through every node and all its further brothers, for the optional word counts
+// section. Positions are the ones in the encoded file, i.e. the first node is at position 1. A list is
+// counted after the lists of its children, in one post-order pass, and the tails shared with longer lists
+// are counted only once.
+void countListWords(const vector<int64_t> &encodedNodes, int list, vector<uint32_t> &wordCounts) {
+    int last = list;
+    while (wordCounts[last] == 0 && !WideNodeFormat::isEndOfList(encodedNodes[last - 1])) {
+        ++last;
+    }
+
+    for (int position = last; position >= list; --position) {
+        if (wordCounts[position] != 0) {
+            continue;
+        }
+        int64_t node = encodedNodes[position - 1];
+        int firstChild = WideNodeFormat::firstChild(node);
+        uint32_t count = WideNodeFormat::isEndOfWord(node) ? 1 : 0;
+        if (firstChild != 0) {
+            if (wordCounts[firstChild] == 0) {
+                countListWords(encodedNodes, firstChild, wordCounts);
+            }
+            count += wordCounts[firstChild];
+        }
+        if (!WideNodeFormat::isEndOfList(node)) {
+            count += wordCounts[position + 1];
+        }
+        wordCounts[position] = count;
     }
-    output.close();
 }
 
-void findWordsInBinaryNodes(int *nodes, int position, string prefix, vector<string>& output) {
-    int node = nodes[position];
+vector<uint32_t> calculateWordCounts(const vector<int64_t> &encodedNodes) {
+    vector<uint32_t> wordCounts(encodedNodes.size() + 1, 0);
+    if (!encodedNodes.empty()) {
+        countListWords(encodedNodes, 1, wordCounts);
+    }
+    return wordCounts;
+}
 
-    char letter = node & KLetterMask;
-    int childIndex = (node & KChildIndexMask) >> KChildBitShift;
-    bool endOfList = (node & KEndOfListFlag) != 0;
-    bool endOfWord = (node & KEndOfWordFlag) != 0;
+// The nodes are built in WideNodeFormat and written in the narrowest of SupportedNodeFormats whose index fits,
+// so only the graphs too large for the 32-bit nodes pay for the wider ones.
+void encodeGraph(const vector<int64_t> &encodedNodes, const vector<uint32_t> &wordCounts) {
+    NodeFileWriter<WideNodeFormat> writer(KEncodedFileName, encodedNodes, wordCounts.empty() ? NULL : wordCounts.data());
+    // Node 0 is not on the list
+    if (!SupportedNodeFormats::dispatchNarrowest(encodedNodes.size() + 1, writer)) {
+        throw length_error("Graph has too many nodes for the DAWG file");
+    }
+    if (!writer.written()) {
+        throw ios_base::failure("Cannot write binary file");
+    }
+    printf("Saved %d nodes, %d bits per node\n", (int)encodedNodes.size(), (int)writer.nodeSize() * 8);
+}
 
-    if (endOfWord) {
-        output.push_back(string(prefix + letter));
+void findWordsInBinaryNodes(const Dawg &dawg, vector<string> &output) {
+    for (CompletionIterator word(dawg, "", 0); word.next();) {
+        output.push_back(string(word.word(), word.length()));
     }
+}
 
-    if (!endOfList) {
-        findWordsInBinaryNodes(nodes, position + 1, prefix, output);
+// Every word has to be found at its position in the order of the iterator, and found back by it.
+void testWordCounts(const Dawg &dawg) {
+    if (!dawg.hasWordCounts()) {
+        return;
     }
 
-    if (childIndex != 0) {
-        findWordsInBinaryNodes(nodes, childIndex, prefix + letter, output);
+    bool matches = true;
+    size_t index = 0;
+    char word[CompletionIterator::KMaxWordLength + 1];
+    for (CompletionIterator i(dawg, "", 0); i.next() && matches; ++index) {
+        matches = dawg.indexOf(i.word(), i.length()) == index &&
+                  dawg.wordAt(index, word, sizeof(word)) == i.length() && strcmp(word, i.word()) == 0;
     }
+    matches = matches && index == dawg.wordCount();
+    assert(matches);
+    (void)matches;
 }
 
-void testEncodedGraph(const Hash &expectedChecksum) {
-    ifstream input(KEncodedFileName, fstream::in | fstream::binary);
-    if (!input.is_open()) {
-        throw ios_base::failure("Cannot open binary file");
+// Returns true if the iterator, started at a word of KMaxWordLength letters, returns the word and then reports
+// the longer word below it instead of writing past its buffer.
+template <class Iterator>
+bool reportsLongWord(Iterator &word, const string &prefix) {
+    if (!word.next() || word.length() != prefix.length() || prefix != word.word()) {
+        return false;
+    }
+    try {
+        word.next();
+    } catch (length_error&) {
+        return true;
     }
+    return false;
+}
+
+// The longest prefix is a word of KMaxWordLength letters with one more letter below it, in Word-List.dat and
+// packed.
+void testCompletionBounds() {
+    const size_t length = CompletionIterator::KMaxWordLength;
+    vector<WideNodeFormat::Node> nodes;
+    for (size_t i = 1; i <= length + 1; ++i) {
+        nodes.push_back(WideNodeFormat::encode('A', i <= length ? i + 1 : 0, i >= length, true));
+    }
+    bool written = writeNodeFile<NarrowNodeFormat, WideNodeFormat>(KBoundsTestFileName, nodes, NULL);
+    assert(written);
+    (void)written;
 
-    int nodeCount;
-    input.read(reinterpret_cast<char*>(&nodeCount), sizeof(int));
-    int *nodes = new int[nodeCount];
-    for (int i(0); i != nodeCount; ++i) {
-        input.read(reinterpret_cast<char*>(nodes + i), sizeof(int));
+    const string prefix(length, 'A');
+    bool reported = false;
+    {
+        Dawg dawg(KBoundsTestFileName);
+        CompletionIterator word(dawg, prefix.data(), prefix.length());
+        reported = reportsLongWord(word, prefix);
+    }
+    {
+        MappedFile encoded(KBoundsTestFileName);
+        size_t packedSize = 0;
+        char *packed = encode(encoded.data(), encoded.size(), &packedSize);
+        if (packed == NULL) {
+            throw ios_base::failure("Cannot pack bounds test file");
+        }
+        ofstream output(KPackedBoundsTestFileName, fstream::out | fstream::binary);
+        output.write(packed, packedSize);
+        output.close();
+        free(packed);
     }
-    input.close();
+    {
+        PackedDawg packedDawg(KPackedBoundsTestFileName);
+        PackedCompletionIterator word(packedDawg, prefix.data(), prefix.length());
+        reported = reportsLongWord(word, prefix) && reported;
+    }
+    remove(KBoundsTestFileName);
+    remove(KPackedBoundsTestFileName);
+    assert(reported);
+    (void)reported;
+}
+
+void testEncodedGraph(const Hash &expectedChecksum) {
+    Dawg dawg(KEncodedFileName);
 
     vector<string> wordList;
-    findWordsInBinaryNodes(nodes, 1, "", wordList);
+    findWordsInBinaryNodes(dawg, wordList);
 
-    sort(wordList.begin(), wordList.end(), sortByLengthThenAlphabetically);
+    sort(wordList.begin(), wordList.end(), sortByLengthThenAlphabetically<string>);
 
     Hash binaryOutput = calculateWordListChecksum(wordList.cbegin(), wordList.cend());
     assert(equal(binaryOutput.cbegin(), binaryOutput.cend(), expectedChecksum.cbegin()));
 
-    delete [] nodes;
+    testWordCounts(dawg);
 }
 
-int main(int argc, char* argv[]) {
-    try {
-        printf("Reading word list\n");
-        vector<string> allWords = readWordList();
+// The graph built from the runs has alphabetically sorted child lists, so instead of a checksum of the whole
+// word list, which would need all the words in memory, the graph is walked together with another merge of
+// the runs.
+void testEncodedGraph(const vector<string> &runs) {
+    Dawg dawg(KEncodedFileName);
+
+    RunMerger words(runs);
+    CompletionIterator encodedWord(dawg, "", 0);
+    Word expected;
+    bool matches = true;
+    while (matches && words.next(expected)) {
+        matches = encodedWord.next() && expected.compare(Word(encodedWord.word(), encodedWord.length())) == 0;
+    }
+    matches = matches && !encodedWord.next();
+    assert(matches);
+    (void)matches;
+
+    testWordCounts(dawg);
+}
+
+// Writes the nodes of Word-List.dat bit-packed, and checks that the packed graph has the same words.
+void packGraph() {
+    vector<char> packed;
+    {
+        MappedFile encoded(KEncodedFileName);
+        size_t packedSize = 0;
+        char *buffer = encode(encoded.data(), encoded.size(), &packedSize);
+        if (buffer == NULL) {
+            throw ios_base::failure("Cannot pack binary file");
+        }
+        packed.assign(buffer, buffer + packedSize);
+        free(buffer);
+    }
+    packed_dawg view;
+    packed_open(&view, packed.data(), packed.size());
+    printf("Will save %d bytes, %d bits per node\n", (int)packed.size(), view.bits_per_node);
 
-        sort(allWords.begin(), allWords.end(), sortByLengthThenAlphabetically);
-        int maxWordLength = allWords.back().length();
+    ofstream output(KPackedFileName, fstream::out | fstream::binary);
+    if (!output.is_open()) {
+        throw ios_base::failure("Cannot open packed file");
+    }
+    output.write(packed.data(), packed.size());
+    output.close();
 
-        printf("Calculate input checksum\n");
-        Hash inputChecksum = calculateWordListChecksum(allWords.cbegin(), allWords.cend());
+    Dawg dawg(KEncodedFileName);
+    PackedDawg packedDawg(KPackedFileName);
+    CompletionIterator word(dawg, "", 0);
+    PackedCompletionIterator packedWord(packedDawg, "", 0);
+    bool matches = true;
+    while (matches && word.next()) {
+        matches = packedWord.next() && strcmp(word.word(), packedWord.word()) == 0 &&
+                  packedDawg.contains(word.word(), word.length());
+    }
+    matches = matches && !packedWord.next();
+    assert(matches);
+    (void)matches;
+}
+
+// Writes the nodes of Word-List.dat, in the format they are stored in, as the constexpr array of the generated
+// header, see embeddeddawg.h. Every node is split into 32-bit words, low word first.
+class EmbeddedNodesWriter
+{
+public:
+    EmbeddedNodesWriter(FILE *output, const string &name, const char *nodes, size_t nodeCount) :
+        mOutput(output),
+        mName(name),
+        mNodes(nodes),
+        mNodeCount(nodeCount)
+    {
+    }
 
-        printf("Creating a trie\n");
-        GraphNode rootNode;
-        buildTrie(allWords, rootNode);
+    template <class Format>
+    void visit() {
+        const size_t wordsPerNode = sizeof(typename Format::Node) / sizeof(uint32_t);
+        const size_t wordCount = mNodeCount * wordsPerNode;
+        const size_t wordsPerLine = 8;
+
+        fprintf(mOutput, "namespace %s {\n", mName.c_str());
+        fprintf(mOutput, "    typedef NodeFormat<int%d_t, %d, %d, %d, %d, %d> Format;\n\n",
+                (int)sizeof(typename Format::Node) * 8, Format::KLetterBits, Format::KIndexShift, Format::KIndexBits,
+                Format::KEndOfListBit, Format::KEndOfWordBit);
+        fprintf(mOutput, "    alignas(64) constexpr uint32_t KNodes[] = {");
+        for (size_t i = 0; i != wordCount; ++i) {
+            // The nodes section is in the byte order of this host, dawg_read_header checked it
+            typename Format::Bits node;
+            memcpy(&node, mNodes + i / wordsPerNode * sizeof(node), sizeof(node));
+            uint32_t word = (uint32_t)(node >> (i % wordsPerNode * 32));
+            fprintf(mOutput, i % wordsPerLine == 0 ? "\n        0x%08x," : " 0x%08x,", word);
+        }
+        fprintf(mOutput, "\n    };\n\n");
+        fprintf(mOutput, "    constexpr EmbeddedDawg<Format> KDawg(KNodes, %d);\n", (int)mNodeCount);
+        fprintf(mOutput, "}\n");
+    }
 
-        rootNode.markFirstAndLastChild();
+private:
+    FILE *mOutput;
+    const string &mName;
+    const char *mNodes;
+    size_t mNodeCount;
+};
 
-        printf("Calculating hash for all nodes\n");
-        rootNode.calculateHash();
+// Writes the nodes of Word-List.dat to a C++ header, to be compiled into programs with a fixed dictionary.
+void embedGraph(const string &name) {
+    MappedFile encoded(KEncodedFileName);
+    dawg_header header;
+    const dawg_section *nodes = NULL;
+    if (dawg_read_header(&header, encoded.data(), encoded.size())) {
+        nodes = dawg_find_section(&header, DAWG_SECTION_NODES);
+    }
+    if (nodes == NULL) {
+        throw ios_base::failure("Cannot embed binary file");
+    }
+    printf("Will save %d nodes as %s::KNodes\n", (int)header.node_count - 1, name.c_str());
 
-        printf("Removing redundant nodes\n");
-        reduceGraph(rootNode, maxWordLength - 1);
+    FILE *output = fopen(KEmbeddedFileName, "w");
+    if (output == NULL) {
+        throw ios_base::failure("Cannot open embedded header file");
+    }
+    fprintf(output, "// Generated by dawggenerator --embed from %s, see embeddeddawg.h.\n", KWordListFileName);
+    fprintf(output, "#ifndef WORD_LIST_%s_H\n#define WORD_LIST_%s_H\n\n", name.c_str(), name.c_str());
+    fprintf(output, "#include \"embeddeddawg.h\"\n\n");
+    EmbeddedNodesWriter writer(output, name, encoded.data() + nodes->offset, header.node_count);
+    bool supported = SupportedNodeFormats::dispatch(header, writer);
+    fprintf(output, "\n#endif\n");
+    bool written = ferror(output) == 0;
+    if (fclose(output) != 0 || !written || !supported) {
+        throw ios_base::failure("Cannot write embedded header file");
+    }
+}
+
+// C++ identifier for the namespace of the embedded DAWG.
+bool isIdentifier(const string &name) {
+    if (name.empty() || isdigit(static_cast<unsigned char>(name[0]))) {
+        return false;
+    }
+    for (auto c = name.begin(); c != name.end(); ++c) {
+        if (!isalnum(static_cast<unsigned char>(*c)) && *c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Options {
+    Options() :
+        mIncremental(false),
+        mSha1Signatures(false),
+        mWordCounts(false),
+        mPacked(false),
+        mThreadCount(1),
+        mLayout(KBuilderLayout),
+        mMeasureLayout(false),
+        mMemoryBudget(0),
+        mTempDirectory(".")
+    {
+    }
+
+    bool mIncremental;
+    bool mSha1Signatures;
+    bool mWordCounts;
+    // Also write the bit-packed Word-List.packed
+    bool mPacked;
+    // Also write Word-List.h with the nodes in this namespace when it's not empty
+    string mEmbedName;
+    unsigned int mThreadCount;
+    NodeLayout mLayout;
+    // Set by --layout and --query-sample; the statistics of the layout are only reported with them
+    bool mMeasureLayout;
+    // Words looked up by the frequency layout and the layout statistics; the word list if empty
+    string mQuerySample;
+    // Out-of-core build is used when it's not 0
+    size_t mMemoryBudget;
+    string mTempDirectory;
+};
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        string argument(argv[i]);
+        if (argument == "--incremental") {
+            options.mIncremental = true;
+        } else if (argument == "--sha1") {
+            options.mSha1Signatures = true;
+        } else if (argument == "--word-counts") {
+            options.mWordCounts = true;
+        } else if (argument == "--packed") {
+            options.mPacked = true;
+        } else if (argument == "--threads" && i + 1 < argc) {
+            int threadCount = atoi(argv[++i]);
+            if (threadCount <= 0) {
+                throw invalid_argument("Invalid number of threads: " + string(argv[i]));
+            }
+            options.mThreadCount = threadCount;
+        } else if (argument == "--memory-budget" && i + 1 < argc) {
+            int megabytes = atoi(argv[++i]);
+            if (megabytes <= 0) {
+                throw invalid_argument("Invalid memory budget: " + string(argv[i]));
+            }
+            options.mMemoryBudget = (size_t)megabytes << 20;
+        } else if (argument == "--layout" && i + 1 < argc) {
+            options.mLayout = parseNodeLayout(argv[++i]);
+            options.mMeasureLayout = true;
+        } else if (argument == "--query-sample" && i + 1 < argc) {
+            options.mQuerySample = argv[++i];
+            options.mMeasureLayout = true;
+        } else if (argument == "--temp-dir" && i + 1 < argc) {
+            options.mTempDirectory = argv[++i];
+        } else if (argument == "--embed" && i + 1 < argc) {
+            options.mEmbedName = argv[++i];
+            if (!isIdentifier(options.mEmbedName)) {
+                throw invalid_argument("Invalid name for the embedded DAWG: " + options.mEmbedName);
+            }
+        } else {
+            throw invalid_argument("Unknown option " + argument + "\nUsage: dawggenerator [--incremental] [--sha1] [--word-counts] [--packed] [--embed NAME] [--threads N] "
+                                   "[--layout builder|bfs|veb|frequency] [--query-sample FILE] "
+                                   "[--memory-budget MB [--temp-dir DIR]]");
+        }
+    }
+    // The out-of-core build never has the whole word list to use instead
+    if (options.mMemoryBudget != 0 && options.mLayout == KFrequencyLayout && options.mQuerySample.empty()) {
+        throw invalid_argument("Frequency layout with --memory-budget needs --query-sample");
+    }
+    return options;
+}
+
+// Reorders the nodes with the layout from the options and reports how many cache lines and pages the lookups
+// of the query sample touch. Without --layout or --query-sample the builder order is kept unmeasured.
+vector<int64_t> arrangeNodes(const vector<int64_t> &encodedNodes, const Options &options, const vector<Word> &words) {
+    if (!options.mMeasureLayout) {
+        return encodedNodes;
+    }
+
+    unique_ptr<WordList> sampleList;
+    const vector<Word> *sample = &words;
+    if (!options.mQuerySample.empty()) {
+        sampleList.reset(new WordList(options.mQuerySample.c_str()));
+        sample = &sampleList->words();
+    }
+
+    vector<int64_t> result = encodedNodes;
+    if (options.mLayout != KBuilderLayout) {
+        printf("Laying out nodes\n");
+        result = layoutNodes(encodedNodes, options.mLayout, *sample);
+    }
+
+    if (!sample->empty()) {
+        LayoutStatistics statistics = measureLayout(result, *sample);
+        printf("Lookups touch %.2f cache lines and %.2f pages on average\n",
+               statistics.mCacheLinesPerLookup, statistics.mPagesPerLookup);
+    }
+    return result;
+}
+
+void buildInMemory(const Options &options) {
+    printf("Reading word list\n");
+    WordList wordList(KWordListFileName);
+    vector<Word> &allWords = wordList.words();
+
+    sort(allWords.begin(), allWords.end(), sortByLengthThenAlphabetically<Word>);
+    int maxWordLength = allWords.back().length();
+
+    printf("Calculate input checksum\n");
+    Hash inputChecksum = calculateWordListChecksum(allWords.cbegin(), allWords.cend());
+
+    TaskPool pool(options.mThreadCount);
+
+    vector<int64_t> encodedNodes;
+    if (options.mIncremental) {
+        encodedNodes = buildIncrementally(allWords);
+    } else if (options.mSha1Signatures) {
+        encodedNodes = buildByReduction<Sha1Signature>(allWords, maxWordLength, pool);
+    } else {
+        encodedNodes = buildByReduction<FastSignature>(allWords, maxWordLength, pool);
+    }
+    encodedNodes = arrangeNodes(encodedNodes, options, allWords);
+
+    vector<uint32_t> wordCounts;
+    if (options.mWordCounts) {
+        printf("Counting words through every node\n");
+        wordCounts = calculateWordCounts(encodedNodes);
+    }
+
+    printf("Encoding graph\n");
+    encodeGraph(encodedNodes, wordCounts);
+
+    printf("Testing procedure - recreate from binary file\n");
+    testEncodedGraph(inputChecksum);
+    testCompletionBounds();
+}
+
+// Neither the word list nor the trie is ever kept in memory: the words are sorted into runs on disk and the
+// merged runs are streamed into the incremental builder, which only holds the minimal graph.
+void buildOutOfCore(const Options &options) {
+    ExternalSorter sorter(options.mTempDirectory, options.mMemoryBudget);
+    {
+        printf("Sorting word list into runs\n");
+        MappedFile input(KWordListFileName);
+        WordTokenizer tokenizer(input.data(), input.data() + input.size());
+        Word word;
+        while (tokenizer.next(word)) {
+            sorter.add(word);
+        }
+        sorter.finish();
+    }
+
+    vector<int64_t> encodedNodes;
+    {
+        printf("Building minimal graph from %d runs\n", (int)sorter.runs().size());
+        RunMerger words(sorter.runs());
+        IncrementalDawgBuilder builder;
+        Word word;
+        while (words.next(word)) {
+            builder.addWord(word);
+        }
 
         printf("Preparing final node list\n");
-        vector<GraphNode*> indexedNodes;
-        rootNode.indexNodes(indexedNodes);
-        assert(indexedNodes.size() < (KChildIndexMask >> KChildBitShift));
-        printf("Will save %d nodes\n", indexedNodes.size());
+        encodedNodes = builder.encode();
+    }
+    encodedNodes = arrangeNodes(encodedNodes, options, vector<Word>());
+
+    vector<uint32_t> wordCounts;
+    if (options.mWordCounts) {
+        printf("Counting words through every node\n");
+        wordCounts = calculateWordCounts(encodedNodes);
+    }
+
+    printf("Encoding graph\n");
+    encodeGraph(encodedNodes, wordCounts);
 
-        printf("Encoding graph\n");
-        encodeGraph(indexedNodes);
+    printf("Testing procedure - recreate from binary file\n");
+    testEncodedGraph(sorter.runs());
+    testCompletionBounds();
+}
 
-        printf("Testing procedure - recreate from binary file\n");
-        testEncodedGraph(inputChecksum);
+int main(int argc, char* argv[]) {
+    try {
+        Options options = parseOptions(argc, argv);
+        if (options.mMemoryBudget != 0) {
+            buildOutOfCore(options);
+        } else {
+            buildInMemory(options);
+        }
+        if (options.mPacked) {
+            printf("Packing graph\n");
+            packGraph();
+        }
+        if (!options.mEmbedName.empty()) {
+            printf("Embedding graph\n");
+            embedGraph(options.mEmbedName);
+        }
     } catch (exception &e) {
         printf("%s\n", e.what());
         return -1;
@@ -16,17 +16,6 @@
  */
 #include "dawgminify.h"
 
-int bit_masks[8] = {
-    0x00000001, // 00000001
-    0x00000003, // 00000011
-    0x00000007, // 00000111
-    0x0000000F, // 00001111
-    0x0000001F, // 00011111
-    0x0000003F, // 00111111
-    0x0000007F, // 01111111
-    0x000000FF, // 11111111
-};
-
 int byte_to_int_offs(const char* in, const int offset)
 {
     return    ( (0xFF & in[offset + 3]) << 24) +
@@ -85,382 +74,777 @@ char* read_file(const char* filename, long* size)
     return buffer;
 }
 
-/**
-    write_bits
+/*
+    node_from_4byte
     
-    Writes bits from an int to a char*
+    Extracts letter, index and the flags from a node.
+    
+    node            the node to read from
+    letter          the letter is written to this
+    index           the index is written to this
+    word_flag       the word flag is written to this
+    end_flag        the end of list flag is written to this
+
+*/
+void node_from_4byte(int node, int* letter, int* index, int* word_flag, int* end_flag)
+{
+    *letter = NODE_LETTER_MASK & node;
+    *index = (NODE_CHILD_MASK & node) >> NODE_CHILD_SHIFT;
+    *word_flag = (node & NODE_WORD_FLAG) > 0;
+    *end_flag = (node & NODE_END_FLAG) > 0;
+}
 
-    val             value to read from
-    nbr_bits        how many bits to write to output from val
-    output          char buffer to read from
-    output_pos      position in output buffer
-    output_bitpos   bit position in output[*output_pos]
+/**
+    packed_layout
     
+    Field widths chosen by the encoder, and the code of every letter of the alphabet.
 */
-void write_bits(int val, char nbr_bits, char* output, int* output_pos, int* output_bitpos)
+typedef struct
 {
-    int will_be_written;
-    int bits_written = 0;
-    int bits_left = nbr_bits;
+    int nbr_nodes;
+    // Bytes per node of the non-compressed DAWG
+    int node_size;
+    int letter_bits;
+    int bits_for_index;
+    int bits_per_node;
+    int alphabet_size;
+    unsigned char alphabet[256];
+    // Letters outside the alphabet, which only node 0 has, get code 0
+    int codes[256];
+} packed_layout;
+
+/**
+    bits_for_values
     
-    while ( bits_written < nbr_bits )
+    Returns how many bits a number from 0 to nbr_values - 1 takes, ceil(log2(nbr_values)).
+    
+    nbr_values      how many different values there are
+    
+*/
+static int bits_for_values(int nbr_values)
+{
+    int bits = 0;
+    while ( bits < 32 && ((int64_t)1 << bits) < nbr_values )
     {
-        bits_left = nbr_bits - bits_written;
-        will_be_written = bits_left > (BITS_IN_BYTE - *output_bitpos) ? (BITS_IN_BYTE - *output_bitpos) : bits_left;
-        output[*output_pos] |= (val >> bits_written) << *output_bitpos;
-        *output_bitpos += will_be_written;
-        bits_written += will_be_written;
-
-        if ( *output_bitpos == BITS_IN_BYTE )
-        {
-            *output_bitpos = 0;
-            (*output_pos)++;
-        }
+        bits++;
     }
+    return bits;
 }
 
 /**
-    read_bits
+    packed_fields
     
-    Read bits from a buffer into val
+    Converts a node of the non-compressed DAWG to a packed node.
+    
+    node            the letter and the flags of the node, the low half of a 64-bit node
+    child           the index of its first child
+    layout          field widths and letter codes
     
-    val             puts value here
-    nbr_bits        how many bits to read
-    input           buffer to read
-    input_po        byte position in input
-    input_bitpos    bit position in input[*input_pos]
-
 */
-void read_bits(int* val, char nbr_bits, char* input, int* input_pos, int* input_bitpos)
+static uint64_t packed_fields(int node, uint32_t child, const packed_layout* layout)
 {
-    *val = 0;
+    // End-Of-List and End-Of-Word follow each other in both formats, so they move together
+    uint64_t flags = ((unsigned int)node >> DAWG32_END_OF_LIST_BIT) & 3;
+    uint64_t packed = layout->codes[node & NODE_LETTER_MASK];
+    packed |= (uint64_t)child << layout->letter_bits;
+    return packed | flags << (layout->letter_bits + layout->bits_for_index);
+}
+
+/**
+    nodes_section_size
     
-    int will_be_read;
-    int bits_read = 0;
-    int bits_left = nbr_bits;
+    Returns the size of the packed nodes, including the padding.
     
-    while ( bits_read < nbr_bits )
-    {
-        bits_left = nbr_bits - bits_read;
-        will_be_read = bits_left > (BITS_IN_BYTE - *input_bitpos) ? (BITS_IN_BYTE - *input_bitpos) : bits_left;
-        *val |= (bit_masks[will_be_read - 1] & (input[*input_pos] >> *input_bitpos)) << bits_read;
-        *input_bitpos += will_be_read;
-        bits_read += will_be_read;
-        
-        if ( *input_bitpos == BITS_IN_BYTE )
-        {
-            *input_bitpos = 0;
-            (*input_pos)++;
-        }
-    }
+*/
+static size_t nodes_section_size(int nbr_nodes, int bits_per_node)
+{
+    return ((uint64_t)nbr_nodes * bits_per_node + BITS_IN_BYTE - 1) / BITS_IN_BYTE + PACKED_PADDING;
 }
 
-/*
-    node_from_4byte
+/**
+    packed_open
     
-    Extracts letter, index and the flags from a node.
+    Fills dawg from the header of a packed file. Returns 0 if the buffer isn't a packed file, or if its
+    fields are not in the order described in dawgminify.h.
+    
+    dawg            the view to fill
+    in              contents of the packed file, must outlive dawg
+    in_size         size of the packed file
     
-    node            the node to read from
-    letter          the letter is written to this
-    index           the index is written to this
-    word_flag       the word flag is written to this
-    end_flag        the end of list flag is written to this
-
 */
-void node_from_4byte(int node, int* letter, int* index, int* word_flag, int* end_flag)
+int packed_open(packed_dawg* dawg, const char* in, size_t in_size)
 {
-    *letter = KLetterMask & node;
-    *index = (KChildIndexMask & node) >> 8;
-    *word_flag = (node & KEndOfWordFlag) > 0;
-    *end_flag = (node & KEndOfListFlag) > 0;
+    int i;
+    dawg_header header;
+    
+    if ( !dawg_read_header(&header, in, in_size) || header.node_format != DAWG_FORMAT_PACKED ||
+         header.node_count > 0x7FFFFFFF || header.letter_shift != 0 || header.index_shift != header.letter_bits ||
+         header.index_bits > PACKED_MAX_INDEX_BITS || header.end_of_list_bit != header.letter_bits + header.index_bits ||
+         header.end_of_word_bit != header.end_of_list_bit + 1 || header.bits_per_node != header.end_of_word_bit + 1 ||
+         header.alphabet_size > (1 << header.letter_bits) )
+    {
+        return 0;
+    }
+    
+    const dawg_section* alphabet = dawg_find_section(&header, DAWG_SECTION_ALPHABET);
+    const dawg_section* nodes = dawg_find_section(&header, DAWG_SECTION_NODES);
+    if ( alphabet == NULL || nodes == NULL || alphabet->size != header.alphabet_size ||
+         nodes->size < nodes_section_size(header.node_count, header.bits_per_node) )
+    {
+        return 0;
+    }
+    
+    dawg->bits = (const unsigned char*) in + nodes->offset;
+    dawg->bits_size = nodes->size;
+    dawg->nbr_nodes = header.node_count;
+    dawg->bits_per_node = header.bits_per_node;
+    dawg->letter_bits = header.letter_bits;
+    dawg->bits_for_index = header.index_bits;
+    dawg->node_mask = ((uint64_t)1 << dawg->bits_per_node) - 1;
+    dawg->letter_mask = ((uint64_t)1 << dawg->letter_bits) - 1;
+    dawg->index_mask = ((uint64_t)1 << dawg->bits_for_index) - 1;
+    dawg->end_flag = (uint64_t)1 << header.end_of_list_bit;
+    dawg->word_flag = (uint64_t)1 << header.end_of_word_bit;
+    dawg->alphabet_size = header.alphabet_size;
+    
+    for ( i = 0; i < 256; i++ )
+    {
+        dawg->letters[i] = 0;
+        dawg->codes[i] = -1;
+    }
+    for ( i = 0; i < dawg->alphabet_size; i++ )
+    {
+        unsigned char letter = in[alphabet->offset + i];
+        dawg->letters[i] = letter;
+        dawg->codes[letter] = i;
+    }
+    return 1;
 }
 
 /**
-    node_from_arb
+    bit_writer
     
-    Extracts letter, index, and the flags from "compressed" node.
+    Appends chunks of bits to the encoded buffer. The chunks are collected in a 64-bit word which is
+    stored whenever it fills up, so a chunk costs a few shifts and at most one store.
+*/
+typedef struct
+{
+    unsigned char* pos;
+    uint64_t word;
+    int bits;
+} bit_writer;
+
+/**
+    write_chunk
     
-    arr                 the buffer to read from
-    pos                 the bytepos in arr
-    bitpos              the bitpos in arr[*pos]
-    bits_for_index      how many bits used to represent the index
-    letter              the letter is written to this
-    index               the index is written to this
-    word_flag           the word flag is written to this
-    end_flag            the end flag is written to this
+    writer          the writer to append to
+    chunk           bits to append, nothing above nbr_bits may be set
+    nbr_bits        how many bits to append, less than 64
     
 */
-void node_from_arb(char* arr, int* pos, int* bitpos, int bits_for_index, int* letter, int* index, int* word_flag, int* end_flag)
+static inline void write_chunk(bit_writer* writer, uint64_t chunk, int nbr_bits)
 {
-    read_bits(word_flag, WORD_MASK_LENGTH, arr, pos, bitpos);
-    read_bits(end_flag, END_MASK_LENGTH, arr, pos, bitpos);
-    read_bits(letter, CHAR_MASK_LENGTH, arr, pos, bitpos);
-    read_bits(index, bits_for_index, arr, pos, bitpos);
+    writer->word |= chunk << writer->bits;
+    writer->bits += nbr_bits;
+    if ( writer->bits >= 64 )
+    {
+        // The bits which didn't fit start the next word
+        store_le64(writer->pos, writer->word);
+        writer->pos += sizeof(writer->word);
+        writer->bits -= 64;
+        writer->word = chunk >> (nbr_bits - writer->bits);
+    }
 }
 
+/*
+    The bulk kernels convert many nodes per iteration. Nodes are at most KERNEL_MAX_BITS_PER_NODE bits
+    wide for them, so that two of them fit in a 64-bit word and four of them, at any bit offset, in 16 bytes.
+    Each kernel handles the nodes from first on and returns the number of the first node it didn't handle;
+    the scalar loops finish the rest.
+*/
+#define KERNEL_MAX_BITS_PER_NODE	(30)
 
-void write_node(int node, char* arr, int* pos, int* bitpos, int bits_for_index)
+static int encode_scalar(const char* nodes, int first, const packed_layout* layout, bit_writer* writer)
 {
-    int letter;
-    int index;
-    int word_flag;
-    int end_flag;
-    
-    node_from_4byte(node, &letter, &index, &word_flag, &end_flag);
-    
-    write_bits(word_flag, WORD_MASK_LENGTH, arr, pos, bitpos);
-    write_bits(end_flag, END_MASK_LENGTH, arr, pos, bitpos);
-    write_bits(letter, CHAR_MASK_LENGTH, arr, pos, bitpos);
-    write_bits(index, bits_for_index, arr, pos, bitpos);
+    int i;
+    // The stores through the writer may alias the layout, so it's copied to keep the fields in registers
+    packed_layout local = *layout;
+    bit_writer out = *writer;
+    if ( local.node_size == BYTES_PER_NODE )
+    {
+        for ( i = first; i < local.nbr_nodes; i++ )
+        {
+            int node;
+            memcpy(&node, nodes + (size_t)i * BYTES_PER_NODE, sizeof(node));
+            uint32_t child = (NODE_CHILD_MASK & node) >> NODE_CHILD_SHIFT;
+            assert(child < (uint32_t)local.nbr_nodes);
+            write_chunk(&out, packed_fields(node, child, &local), local.bits_per_node);
+        }
+    }
+    else
+    {
+        for ( i = first; i < local.nbr_nodes; i++ )
+        {
+            int64_t node;
+            memcpy(&node, nodes + (size_t)i * BYTES_PER_WIDE_NODE, sizeof(node));
+            uint32_t child = (uint32_t)(node >> DAWG64_INDEX_SHIFT);
+            assert(child < (uint32_t)local.nbr_nodes);
+            write_chunk(&out, packed_fields((int)node, child, &local), local.bits_per_node);
+        }
+    }
+    *writer = out;
+    return local.nbr_nodes;
 }
 
-char* encode(char* in, size_t in_size, size_t* out_size)
+static int decode_scalar(const packed_dawg* dawg, int first, int* out)
 {
-    int node;
-    int pos;
-    int byte_pos;
-    int bit_pos;
-    
-    int nbr_nodes = byte_to_int_offs(in, 0);
-    int bits_for_index = (int)(ceil(log(nbr_nodes) / log(2.0)));
-    int bits_per_node = WORD_MASK_LENGTH + CHAR_MASK_LENGTH + END_MASK_LENGTH + bits_for_index;
-    int odd_bits = (bits_per_node * nbr_nodes) % 8;
-    int total_bytes = (bits_per_node * nbr_nodes + odd_bits) / 8 + 4;
-    
-    printf("Nodes:               %d\n", nbr_nodes);
-    printf("Bits/index:          %d\n", bits_for_index);
-    printf("Bits/node:           %d\n", bits_per_node);
-    printf("Odd bits:            %d\n", odd_bits);
-    printf("Bytes in new file:   %d\n", total_bytes);
-    printf("%% smaller:           %.3f%%\n", 1 - (total_bytes/(float)in_size));
-    
-    char* out = (char*) malloc( total_bytes );
-    check_ptr(out);
-    
-    memcpy(out, in, 4);
-    pos = 4; // Skip first 4 since its for nodecount
-    byte_pos = 4;
-    bit_pos = 0;
-    
-    while ( pos < in_size )
+    int i;
+    for ( i = first; i < dawg->nbr_nodes; i++ )
+    {
+        out[i] = unpacked_node(dawg, packed_node(dawg, i));
+    }
+    return dawg->nbr_nodes;
+}
+
+static int decode_scalar_wide(const packed_dawg* dawg, int first, int64_t* out)
+{
+    int i;
+    for ( i = first; i < dawg->nbr_nodes; i++ )
     {
-        node = byte_to_int_offs(in, (int)pos);
-        write_node(node, out, &byte_pos, &bit_pos, bits_for_index);
-        pos += 4;
+        out[i] = unpacked_wide_node(dawg, packed_node(dawg, i));
     }
+    return dawg->nbr_nodes;
+}
+
+#if defined(__x86_64__)
+#define DAWGMINIFY_X86_KERNELS
+#include <immintrin.h>
+
+/**
+    pair_mask
     
-    *out_size = total_bytes;
-    return out;
+    Returns the mask of the bits of two 32-bit nodes, side by side in a 64-bit word, which are kept in
+    packed nodes: the bits of the letter code, the index and the flags.
+    
+*/
+static uint64_t pair_mask(int letter_bits, int bits_for_index)
+{
+    uint64_t mask = (((uint64_t)1 << letter_bits) - 1) |
+                    ((((uint64_t)1 << bits_for_index) - 1) << NODE_CHILD_SHIFT) | NODE_END_FLAG | NODE_WORD_FLAG;
+    return mask | (mask << 32);
 }
 
-char* decode(char* in, size_t in_size, size_t* out_size)
+/**
+    encode_bmi2
+    
+    Replaces the letters of two nodes with their codes and squeezes out the unused bits of both with a
+    single pext.
+*/
+__attribute__((target("bmi2")))
+static int encode_bmi2(const char* nodes, int first, const packed_layout* layout, bit_writer* writer)
 {
-    int letter;
-    int index;
-    int word_flag;
-    int end_flag;
-    int byte_pos;
-    int bit_pos;
-    int node_pos;
+    int i;
+    uint64_t mask = pair_mask(layout->letter_bits, layout->bits_for_index);
+    
+    for ( i = first; i + 2 <= layout->nbr_nodes; i += 2 )
+    {
+        uint64_t pair;
+        memcpy(&pair, nodes + (size_t)i * BYTES_PER_NODE, sizeof(pair));
+        pair = (pair & ~0x000000FF000000FFULL) | (uint64_t)layout->codes[pair & 0xFF] |
+               ((uint64_t)layout->codes[(pair >> 32) & 0xFF] << 32);
+        write_chunk(writer, _pext_u64(pair, mask), 2 * layout->bits_per_node);
+    }
+    return i;
+}
 
-    int nbr_nodes = byte_to_int_offs(in, 0);
-    int bits_for_index = (int)(ceil(log(nbr_nodes) / log(2.0)));
-    *out_size = nbr_nodes * 4 + 4;
+/**
+    decode_bmi2
     
-    int* out = (int*) malloc(*out_size);
-    check_ptr(out);
-    out[0] = nbr_nodes;
+    Takes two consecutive nodes with one unaligned 128-bit load and a shift, spreads their fields to the
+    positions of two 32-bit nodes with a single pdep, and replaces the letter codes with the letters.
+*/
+__attribute__((target("bmi2")))
+static int decode_bmi2(const packed_dawg* dawg, int first, int* out)
+{
+    int i;
+    uint64_t mask = pair_mask(dawg->letter_bits, dawg->bits_for_index);
+    uint64_t codes_mask = dawg->letter_mask | (dawg->letter_mask << 32);
+    uint64_t bit = (uint64_t)first * dawg->bits_per_node;
     
-    byte_pos = 4;
-    bit_pos = 0;
-    node_pos = 1;
+    for ( i = first; i + 2 <= dawg->nbr_nodes && (bit >> 3) + 16 <= dawg->bits_size; i += 2 )
+    {
+        unsigned __int128 window;
+        memcpy(&window, dawg->bits + (bit >> 3), sizeof(window));
+        uint64_t pair = _pdep_u64((uint64_t)(window >> (bit & 7)), mask);
+        pair = (pair & ~codes_mask) | (uint64_t)dawg->letters[pair & dawg->letter_mask] |
+               ((uint64_t)dawg->letters[(pair >> 32) & dawg->letter_mask] << 32);
+        memcpy(out + i, &pair, sizeof(pair));
+        bit += 2 * dawg->bits_per_node;
+    }
+    return i;
+}
+
+/**
+    encode_avx2
     
-    while ( byte_pos < in_size )
+    Converts eight nodes at once, looking up the letter codes with a gather, then joins every pair of them
+    in a 64-bit lane with a shift, so only four chunks are left for the bit writer.
+*/
+__attribute__((target("avx2")))
+static int encode_avx2(const char* nodes, int first, const packed_layout* layout, bit_writer* writer)
+{
+    int i;
+    int flags_shift = layout->letter_bits + layout->bits_for_index;
+    const __m256i letter_mask = _mm256_set1_epi32(NODE_LETTER_MASK);
+    const __m256i index_mask = _mm256_set1_epi32(NODE_CHILD_MASK);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i low_half = _mm256_set1_epi64x(0xFFFFFFFF);
+    const __m128i index_shift = _mm_cvtsi32_si128(NODE_CHILD_SHIFT - layout->letter_bits);
+    const __m128i end_shift = _mm_cvtsi32_si128(flags_shift);
+    const __m128i word_shift = _mm_cvtsi32_si128(flags_shift + 1);
+    const __m128i pair_shift = _mm_cvtsi32_si128(layout->bits_per_node);
+    uint64_t chunks[4];
+    
+    for ( i = first; i + 8 <= layout->nbr_nodes; i += 8 )
     {
-        node_from_arb(in, &byte_pos, &bit_pos, bits_for_index, &letter, &index, &word_flag, &end_flag);
+        __m256i block = _mm256_loadu_si256((const __m256i*)(nodes + (size_t)i * BYTES_PER_NODE));
+        __m256i packed = _mm256_i32gather_epi32(layout->codes, _mm256_and_si256(block, letter_mask), 4);
+        packed = _mm256_or_si256(packed, _mm256_srl_epi32(_mm256_and_si256(block, index_mask), index_shift));
+        packed = _mm256_or_si256(packed, _mm256_sll_epi32(
+            _mm256_and_si256(_mm256_srli_epi32(block, DAWG32_END_OF_LIST_BIT), one), end_shift));
+        packed = _mm256_or_si256(packed, _mm256_sll_epi32(
+            _mm256_and_si256(_mm256_srli_epi32(block, DAWG32_END_OF_WORD_BIT), one), word_shift));
         
-        out[node_pos] = index << KChildBitShift;
-        out[node_pos] += KLetterMask & letter;
-        if (word_flag) out[node_pos] += KEndOfWordFlag;
-        if (end_flag) out[node_pos] += KEndOfListFlag;
-        
-        node_pos++;
+        __m256i pairs = _mm256_or_si256(_mm256_and_si256(packed, low_half),
+                                        _mm256_sll_epi64(_mm256_srli_epi64(packed, 32), pair_shift));
+        _mm256_storeu_si256((__m256i*)chunks, pairs);
+        write_chunk(writer, chunks[0], 2 * layout->bits_per_node);
+        write_chunk(writer, chunks[1], 2 * layout->bits_per_node);
+        write_chunk(writer, chunks[2], 2 * layout->bits_per_node);
+        write_chunk(writer, chunks[3], 2 * layout->bits_per_node);
+    }
+    return i;
+}
+
+/**
+    decode_avx2
+    
+    Eight nodes take exactly bits_per_node bytes, so every group of eight starts at a byte boundary and the
+    byte offsets and shifts of its nodes are the same for all groups. The first four nodes of a group are
+    loaded to the lower half of a register and the other four to the upper half; two byte shuffles copy the
+    bytes of every node to its own 64-bit lane, where a variable shift aligns it. The low halves of the
+    lanes are then gathered into eight 32-bit lanes, and the fields are moved to their places, with the
+    letters looked up by a gather.
+*/
+__attribute__((target("avx2")))
+static int decode_avx2(const packed_dawg* dawg, int first, int* out)
+{
+    int i;
+    int k;
+    int bits_per_node = dawg->bits_per_node;
+    int flags_shift = dawg->letter_bits + dawg->bits_for_index;
+    int upper_offset = 4 * bits_per_node / BITS_IN_BYTE;
+    char shuffles[2][32];
+    long long shifts[2][4];
+    
+    // Node k goes to lane k % 2 of half k / 4 in register k / 2 % 2
+    for ( k = 0; k < 8; k++ )
+    {
+        int bit = k * bits_per_node - (k < 4 ? 0 : upper_offset * BITS_IN_BYTE);
+        int lane = (k / 4) * 2 + k % 2;
+        int j;
+        for ( j = 0; j < 8; j++ )
+        {
+            int byte = bit / BITS_IN_BYTE + j;
+            shuffles[k / 2 % 2][lane * 8 + j] = byte < 16 ? byte : (char)0x80;
+        }
+        shifts[k / 2 % 2][lane] = bit % BITS_IN_BYTE;
     }
     
-    return (char*) out;
+    const __m256i shuffle_a = _mm256_loadu_si256((const __m256i*)shuffles[0]);
+    const __m256i shuffle_b = _mm256_loadu_si256((const __m256i*)shuffles[1]);
+    const __m256i shift_a = _mm256_loadu_si256((const __m256i*)shifts[0]);
+    const __m256i shift_b = _mm256_loadu_si256((const __m256i*)shifts[1]);
+    const __m256i letter_mask = _mm256_set1_epi32((int)dawg->letter_mask);
+    const __m256i index_mask = _mm256_set1_epi32((int)(dawg->index_mask << NODE_CHILD_SHIFT));
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m128i index_shift = _mm_cvtsi32_si128(NODE_CHILD_SHIFT - dawg->letter_bits);
+    const __m128i end_shift = _mm_cvtsi32_si128(flags_shift);
+    const __m128i word_shift = _mm_cvtsi32_si128(flags_shift + 1);
+    
+    // Groups start at a byte boundary only if the first node does
+    assert(first % 8 == 0);
+    const unsigned char* group = dawg->bits + (size_t)first / 8 * bits_per_node;
+    for ( i = first; i + 8 <= dawg->nbr_nodes && (size_t)(group - dawg->bits) + upper_offset + 16 <= dawg->bits_size; i += 8 )
+    {
+        __m256i bytes = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)group)),
+            _mm_loadu_si128((const __m128i*)(group + upper_offset)), 1);
+        __m256i a = _mm256_srlv_epi64(_mm256_shuffle_epi8(bytes, shuffle_a), shift_a);
+        __m256i b = _mm256_srlv_epi64(_mm256_shuffle_epi8(bytes, shuffle_b), shift_b);
+        __m256i packed = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b),
+                                                               _MM_SHUFFLE(2, 0, 2, 0)));
+        
+        __m256i nodes = _mm256_i32gather_epi32(dawg->letters, _mm256_and_si256(packed, letter_mask), 4);
+        nodes = _mm256_or_si256(nodes, _mm256_and_si256(_mm256_sll_epi32(packed, index_shift), index_mask));
+        nodes = _mm256_or_si256(nodes, _mm256_slli_epi32(
+            _mm256_and_si256(_mm256_srl_epi32(packed, end_shift), one), DAWG32_END_OF_LIST_BIT));
+        nodes = _mm256_or_si256(nodes, _mm256_slli_epi32(
+            _mm256_and_si256(_mm256_srl_epi32(packed, word_shift), one), DAWG32_END_OF_WORD_BIT));
+        _mm256_storeu_si256((__m256i*)(out + i), nodes);
+        group += bits_per_node;
+    }
+    return i;
 }
+#endif
 
-void selftest()
+/**
+    codec_supported
+    
+    Returns whether the CPU supports the kernel.
+    
+*/
+int codec_supported(codec_kernel kernel)
 {
-    // TEST write_bits
+    switch ( kernel )
+    {
+    case CODEC_SCALAR:
+        return 1;
+#ifdef DAWGMINIFY_X86_KERNELS
+    case CODEC_BMI2:
+        return __builtin_cpu_supports("bmi2");
+    case CODEC_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return 0;
+    }
+}
+
+/**
+    best_codec_kernel
     
-    int pos = 0;
-    int bit_pos = 0;
+    Returns the kernel used by encode and decode: AVX2, which converts eight nodes per iteration, then BMI2,
+    which converts two.
     
-    char* arr = (char*) malloc(4);
-    char* crr = (char*) malloc(4);
-    if ( arr == NULL || crr == NULL )
+*/
+codec_kernel best_codec_kernel(void)
+{
+    if ( codec_supported(CODEC_AVX2) )
     {
-        printf("malloc failed\n");
-        exit(1);
+        return CODEC_AVX2;
+    }
+    if ( codec_supported(CODEC_BMI2) )
+    {
+        return CODEC_BMI2;
     }
+    return CODEC_SCALAR;
+}
+
+/**
+    find_nodes
     
-    // 10001111 10101010 00000000 11111111
-    int correct = 0x8FAA00FF;
+    Returns the nodes of a non-compressed DAWG, writes their number to nbr_nodes and their size, 4 or 8
+    bytes, to node_size, or returns NULL if in isn't one. Files written before the header was introduced
+    only have the node count before the 32-bit nodes.
     
-    //                                  ..
-    // 00000000 00000000 00000000 00000011
-    write_bits(0xFF, 2, arr, &pos, &bit_pos);    
+*/
+static const char* find_nodes(const char* in, size_t in_size, int* nbr_nodes, int* node_size)
+{
+    dawg_header header;
+    if ( dawg_read_header(&header, in, in_size) )
+    {
+        const dawg_section* nodes = dawg_find_section(&header, DAWG_SECTION_NODES);
+        *node_size = dawg_words_node_size(&header);
+        if ( *node_size == 0 || header.node_count > DAWG64_MAX_NODE_COUNT || nodes == NULL ||
+             nodes->size < header.node_count * *node_size )
+        {
+            return NULL;
+        }
+        *nbr_nodes = header.node_count;
+        return in + nodes->offset;
+    }
     
-    //                            ......    
-    // 00000000 00000000 00000000 11111111
-    write_bits(0xFF, 6, arr, &pos, &bit_pos);    
+    if ( in_size < 4 )
+    {
+        return NULL;
+    }
+    *nbr_nodes = byte_to_int_offs(in, 0);
+    *node_size = BYTES_PER_NODE;
+    if ( *nbr_nodes < 0 || in_size < 4 + (size_t)*nbr_nodes * BYTES_PER_NODE )
+    {
+        return NULL;
+    }
+    return in + 4;
+}
+
+/**
+    choose_layout
     
-    //                           
-    // 00000000 00000000 00000000 11111111
-    write_bits(0xFF, 0, arr, &pos, &bit_pos);
+    Collects the alphabet of the nodes and picks the narrowest fields for it and for the node count.
     
-    //                 . ........
-    // 00000000 00000010 00000000 11111111
-    write_bits(0x00, 9, arr, &pos, &bit_pos);
+*/
+static void choose_layout(const char* nodes, int nbr_nodes, int node_size, packed_layout* layout)
+{
+    int i;
+    int used[256] = { 0 };
     
-    //            .....
-    // 00000000 00101010 00000000 11111111
-    write_bits(0x15, 5, arr, &pos, &bit_pos);
+    // Node 0 is empty, its letter is not a part of the alphabet. The letter is in the low half of the
+    // 64-bit nodes.
+    for ( i = 1; i < nbr_nodes; i++ )
+    {
+        int node;
+        if ( node_size == BYTES_PER_NODE )
+        {
+            memcpy(&node, nodes + (size_t)i * BYTES_PER_NODE, sizeof(node));
+        }
+        else
+        {
+            int64_t wide_node;
+            memcpy(&wide_node, nodes + (size_t)i * BYTES_PER_WIDE_NODE, sizeof(wide_node));
+            node = (int)wide_node;
+        }
+        used[node & NODE_LETTER_MASK] = 1;
+    }
     
-    //        . ..
-    // 00000001 10101010 00000000 11111111
-    write_bits(0x06, 3, arr, &pos, &bit_pos);
+    layout->nbr_nodes = nbr_nodes;
+    layout->node_size = node_size;
+    layout->alphabet_size = 0;
+    for ( i = 0; i < 256; i++ )
+    {
+        layout->codes[i] = 0;
+        if ( used[i] )
+        {
+            layout->codes[i] = layout->alphabet_size;
+            layout->alphabet[layout->alphabet_size++] = i;
+        }
+    }
+    layout->letter_bits = bits_for_values(layout->alphabet_size);
+    layout->bits_for_index = bits_for_values(nbr_nodes);
+    layout->bits_per_node = layout->letter_bits + layout->bits_for_index + WORD_MASK_LENGTH + END_MASK_LENGTH;
+}
 
-    // .......
-    // 10001111 10101010 00000000 11111111
-    write_bits(0x47, 7, arr, &pos, &bit_pos);
+/**
+    encode_with
     
-    assert(!(correct ^ byte_to_int_offs(arr, 0)));
-    printf("OK: write_bits()\n");
+    Packs the nodes of a non-compressed DAWG with given kernel, or with the scalar loop if the CPU doesn't
+    support it. The word counts section is not carried over. Returns NULL if in isn't a non-compressed DAWG.
     
-    free(arr);
-    free(crr);
+    kernel          the kernel to use
+    in              contents of Word-List.dat
+    in_size         size of in
+    out_size        size of the returned buffer is written to this
     
-    // END write_bits TEST
+*/
+char* encode_with(codec_kernel kernel, const char* in, size_t in_size, size_t* out_size)
+{
+    int nbr_nodes;
+    int node_size;
+    const char* nodes = find_nodes(in, in_size, &nbr_nodes, &node_size);
+    if ( nodes == NULL )
+    {
+        return NULL;
+    }
     
-    // TEST Simple encode one node
+    packed_layout layout;
+    choose_layout(nodes, nbr_nodes, node_size, &layout);
+    
+    dawg_header header;
+    dawg_header_init(&header, DAWG_FORMAT_PACKED, nbr_nodes);
+    header.bits_per_node = layout.bits_per_node;
+    header.letter_bits = layout.letter_bits;
+    header.letter_shift = 0;
+    header.index_bits = layout.bits_for_index;
+    header.index_shift = layout.letter_bits;
+    header.end_of_list_bit = layout.letter_bits + layout.bits_for_index;
+    header.end_of_word_bit = header.end_of_list_bit + 1;
+    header.alphabet_size = layout.alphabet_size;
+    // The bit stream is little-endian on every host
+    header.byte_order = DAWG_LITTLE_ENDIAN;
+    dawg_add_section(&header, DAWG_SECTION_ALPHABET, layout.alphabet_size);
+    dawg_add_section(&header, DAWG_SECTION_NODES, nodes_section_size(nbr_nodes, layout.bits_per_node));
+    *out_size = dawg_layout_sections(&header);
+    
+    unsigned char* out = (unsigned char*) calloc(*out_size, 1);
+    check_ptr(out);
+    dawg_write_prefix(&header, out);
+    memcpy(out + header.sections[0].offset, layout.alphabet, layout.alphabet_size);
+    
+    // Word-List.dat has native endian nodes, and the bulk kernels only run on little endian CPUs and only
+    // read 32-bit nodes
+    bit_writer writer = { out + header.sections[1].offset, 0, 0 };
+    int first = 0;
+    if ( !codec_supported(kernel) || layout.bits_per_node > KERNEL_MAX_BITS_PER_NODE || node_size != BYTES_PER_NODE )
+    {
+        kernel = CODEC_SCALAR;
+    }
+    switch ( kernel )
+    {
+#ifdef DAWGMINIFY_X86_KERNELS
+    case CODEC_BMI2:
+        first = encode_bmi2(nodes, first, &layout, &writer);
+        break;
+    case CODEC_AVX2:
+        first = encode_avx2(nodes, first, &layout, &writer);
+        break;
+#endif
+    default:
+        break;
+    }
+    encode_scalar(nodes, first, &layout, &writer);
     
-    // Sample node "nocArr" Letter A, Index: 2, No wordflag, Yes endflag
-    // Encode it and then decode it and make sure it's correct
+    // The padding leaves room for the whole word
+    store_le64(writer.pos, writer.word);
+    return (char*) out;
+}
+
+/**
+    decode_with
+    
+    Unpacks a packed file back to a non-compressed DAWG with given kernel, or with the scalar loop if the
+    CPU doesn't support it. The nodes are 64-bit if the 32-bit nodes cannot address them; only the scalar
+    loop writes those. Returns NULL if in isn't a packed file.
     
-    int res_letter;
-    int res_index;
-    int res_word_flag;
-    int res_end_flag;
-    int bits_for_index = 6;
-    char* nocArr = (char*) malloc(4);
-    char* testArr = (char*) malloc(4);
-    if ( nocArr == NULL || testArr == NULL )
+    kernel          the kernel to use
+    in              contents of the packed file
+    in_size         size of in
+    out_size        size of the returned buffer is written to this
+    
+*/
+char* decode_with(codec_kernel kernel, const char* in, size_t in_size, size_t* out_size)
+{
+    packed_dawg dawg;
+    if ( !packed_open(&dawg, in, in_size) )
     {
-        printf("malloc failed\n");
-        exit(1);
+        return NULL;
     }
     
-    nocArr[0] = 0x41; // A
-    nocArr[1] = 0x02; // Index 2
-    nocArr[2] = 0x00;
-    nocArr[3] = 0x10; // Endflag, no wordflag
+    int node_size = dawg_node_size_for(dawg.nbr_nodes);
+    dawg_header header;
+    dawg_header_init_words(&header, dawg.nbr_nodes, node_size);
+    dawg_add_section(&header, DAWG_SECTION_NODES, (uint64_t)dawg.nbr_nodes * node_size);
+    *out_size = dawg_layout_sections(&header);
     
-    // Write the node to the "testArr"
-    pos = 0;
-    bit_pos = 0;
-    write_node(byte_to_int_offs(nocArr, 0), testArr, &pos, &bit_pos, bits_for_index);
+    char* out = (char*) malloc(*out_size);
+    check_ptr(out);
+    dawg_write_prefix(&header, (unsigned char*) out);
     
-    // Read the node from "testArr"
-    pos = 0;
-    bit_pos = 0;
-    node_from_arb(testArr, &pos, &bit_pos, bits_for_index, &res_letter, &res_index, &res_word_flag, &res_end_flag);
+    if ( node_size == BYTES_PER_WIDE_NODE )
+    {
+        int64_t* wide_nodes = (int64_t*) (out + header.sections[0].offset);
+        decode_scalar_wide(&dawg, 0, wide_nodes);
+        wide_nodes[0] = 0;
+        return out;
+    }
+    
+    int* nodes = (int*) (out + header.sections[0].offset);
+    int first = 0;
+    if ( !codec_supported(kernel) || dawg.bits_per_node > KERNEL_MAX_BITS_PER_NODE )
+    {
+        kernel = CODEC_SCALAR;
+    }
+    switch ( kernel )
+    {
+#ifdef DAWGMINIFY_X86_KERNELS
+    case CODEC_BMI2:
+        first = decode_bmi2(&dawg, first, nodes);
+        break;
+    case CODEC_AVX2:
+        first = decode_avx2(&dawg, first, nodes);
+        break;
+#endif
+    default:
+        break;
+    }
+    decode_scalar(&dawg, first, nodes);
     
-    assert((char)res_letter == 'A');
-    assert(res_index == 2);
-    assert((0x0000000F & res_word_flag) == 0);
-    assert((0x0000000F & res_end_flag) == 1);
-    printf("OK: Simple encode one node\n");
+    // Node 0 has no letter, not the letter with code 0
+    if ( dawg.nbr_nodes > 0 )
+    {
+        nodes[0] = 0;
+    }
+    return out;
+}
+
+/**
+    encode
     
-    free(nocArr);
-    free(testArr);
+    Packs the nodes of a non-compressed DAWG with the best kernel for the CPU, see encode_with.
     
-    // END Simple encode one node TEST
+*/
+char* encode(const char* in, size_t in_size, size_t* out_size)
+{
+    return encode_with(best_codec_kernel(), in, in_size, out_size);
+}
+
+/**
+    decode
     
+    Unpacks a packed file with the best kernel for the CPU, see decode_with.
     
+*/
+char* decode(const char* in, size_t in_size, size_t* out_size)
+{
+    return decode_with(best_codec_kernel(), in, in_size, out_size);
+}
+
+void selftest()
+{
     // TEST Encode arr with words AR and AB
     // File contains: 04 00 00 00 00 00 00 00 41 02 00 10 52 00 00 20 42 00 00 30
     
-    nocArr = (char*) malloc(12);
-    testArr = (char*) malloc(12);
-    if ( nocArr == NULL || testArr == NULL )
-    {
-        printf("malloc failed\n");
-        exit(1);
-    }
+    const char nocArr[20] = {
+        0x04, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, // Empty zero node
+        0x41, 0x02, 0x00, 0x10, // A, index 2, endflag, no wordflag
+        0x52, 0x00, 0x00, 0x20, // R, index 0, no endflag, wordflag
+        0x42, 0x00, 0x00, 0x30, // B, index 0, endflag and wordflag
+    };
     
-    // Node 1
-    nocArr[0] = 0x41; // A
-    nocArr[1] = 0x02; // Index 2
-    nocArr[2] = 0x00;
-    nocArr[3] = 0x10; // Endflag, no wordflag
-    
-    // Node 2
-    nocArr[4] = 0x52; // R
-    nocArr[5] = 0x00; // Index 0
-    nocArr[6] = 0x00;
-    nocArr[7] = 0x20; // No endflag, wordflag
-    
-    // Node 3
-    nocArr[8] = 0x42; // B
-    nocArr[9] = 0x00; // Index 0
-    nocArr[10] = 0x00;
-    nocArr[11] = 0x30; // Endflag and wordflag
-    
-    pos = 0;
-    bit_pos = 0;
-    write_node(byte_to_int_offs(nocArr, 0), testArr, &pos, &bit_pos, bits_for_index);
-    write_node(byte_to_int_offs(nocArr, 4), testArr, &pos, &bit_pos, bits_for_index);
-    write_node(byte_to_int_offs(nocArr, 8), testArr, &pos, &bit_pos, bits_for_index);
-    
-    
-    // Read the node from "testArr"
-    pos = 0;
-    bit_pos = 0;
-    node_from_arb(testArr, &pos, &bit_pos, bits_for_index, &res_letter, &res_index, &res_word_flag, &res_end_flag);
-    assert((char)res_letter == 'A');
-    assert(res_index == 2);
-    assert((0x0000000F & res_word_flag) == 0);
-    assert((0x0000000F & res_end_flag) == 1);
-    
-    node_from_arb(testArr, &pos, &bit_pos, bits_for_index, &res_letter, &res_index, &res_word_flag, &res_end_flag);
-    assert((char)res_letter == 'R');
-    assert(res_index == 0);
-    assert((0x0000000F & res_word_flag) == 1);
-    assert((0x0000000F & res_end_flag) == 0);
-    
-    node_from_arb(testArr, &pos, &bit_pos, bits_for_index, &res_letter, &res_index, &res_word_flag, &res_end_flag);
-    assert((char)res_letter == 'B');
-    assert(res_index == 0);
-    assert((0x0000000F & res_word_flag) == 1);
-    assert((0x0000000F & res_end_flag) == 1);
+    size_t encoded_size;
+    char* encoded = encode(nocArr, sizeof(nocArr), &encoded_size);
+    check_ptr(encoded);
+    
+    packed_dawg dawg;
+    assert(packed_open(&dawg, encoded, encoded_size));
+    
+    // 3 letters take 2 bits, 4 nodes take 2 bits, and 2 flags
+    assert(dawg.alphabet_size == 3);
+    assert(dawg.bits_per_node == 6);
+    
+    uint64_t node = packed_node(&dawg, 1);
+    assert(packed_letter(&dawg, node) == 'A');
+    assert(packed_child(&dawg, node) == 2);
+    assert(!(node & dawg.word_flag));
+    assert(node & dawg.end_flag);
+    
+    node = packed_node(&dawg, 2);
+    assert(packed_letter(&dawg, node) == 'R');
+    assert(packed_child(&dawg, node) == 0);
+    assert(node & dawg.word_flag);
+    assert(!(node & dawg.end_flag));
+    
+    node = packed_node(&dawg, 3);
+    assert(packed_letter(&dawg, node) == 'B');
+    assert(packed_child(&dawg, node) == 0);
+    assert(node & dawg.word_flag);
+    assert(node & dawg.end_flag);
     printf("OK: Encode array with \"AR\" and \"AB\"\n");
     
-    printBits(byte_to_int_offs(nocArr, 0));
-    printBits(byte_to_int_offs(nocArr, 4));
-    printBits(byte_to_int_offs(nocArr, 8));
-    
-    printf("\n");
-    printBits(byte_to_int_offs(testArr, 0));
-    printBits(byte_to_int_offs(testArr, 4));
-    printBits(byte_to_int_offs(testArr, 8));
+    size_t decoded_size;
+    char* decoded = decode(encoded, encoded_size, &decoded_size);
+    check_ptr(decoded);
+    int nbr_nodes;
+    int node_size;
+    const char* decoded_nodes = find_nodes(decoded, decoded_size, &nbr_nodes, &node_size);
+    assert(decoded_nodes != NULL && nbr_nodes == 4 && node_size == BYTES_PER_NODE);
+    assert(memcmp(decoded_nodes, nocArr + 4, sizeof(nocArr) - 4) == 0);
+    printf("OK: Decode array with \"AR\" and \"AB\"\n");
     
-    free(nocArr);
-    free(testArr);
+    free(encoded);
+    free(decoded);
     
     // END Encode arr with words AR and AB TEST
-    
 }
 
 void write_buff_to_file(const char* filename, char* buff, size_t buff_size)
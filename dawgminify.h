@@ -18,45 +18,172 @@
 #define DAWGMINIFY_H
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
 #include <string.h>
 
+#include "dawgformat.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define BITS_IN_BYTE		(8)
 #define BITS_PER_CHAR		(8)
 
 /* FOR COMPRESSED DAWG */
-#define WORD_MASK 			(0x00000001)
-#define CHAR_MASK 			(0x0000FF00)
-#define END_MASK  			(0x00000002)
-
+/*
+ * A DAWG_FORMAT_PACKED file (see dawgformat.h) has an alphabet section and a nodes section. Every node
+ * takes bits_per_node bits, stored little-endian right after the previous one: the code of its letter in
+ * the alphabet (letter_bits, just enough for the alphabet), the index of its first child (index_bits, just
+ * enough for the node count), the End-Of-Children-List flag and the End-Of-Word flag. Node i starts at bit
+ * i * bits_per_node of the nodes section, so it is read with a single unaligned 64-bit load, a shift by
+ * less than 8 and a mask. The node is at most PACKED_MAX_BITS_PER_NODE bits wide: 41 bits for an 8-bit
+ * letter code, the 31-bit index of the signed 32-bit node numbers and the two flags. So even after a shift
+ * by 7 it fits in the loaded word, and PACKED_PADDING zero bytes at the end of the section keep the load of
+ * the last node in bounds.
+ *
+ * The fields go in the same order as in the 32-bit nodes, so with the letter replaced by its code, a
+ * 32-bit node becomes a packed node by dropping the unused bits between the fields, and back.
+ */
 #define WORD_MASK_LENGTH 	(0x00000001)
 #define END_MASK_LENGTH 	(0x00000001)
 #define CHAR_MASK_LENGTH 	(0x00000008)
 
-/* FOR BLITZKREIG */
-#define BYTES_PER_NODE		(4)
-#define KChildBitShift		(10)
-#define KChildIndexMask		(0xFFFFFF00)
-#define KLetterMask			(0x000000FF)
-#define KEndOfWordFlag		(0x00000200)
-#define KEndOfListFlag		(0x00000100)
+#define PACKED_PADDING		(8)
+#define PACKED_MAX_INDEX_BITS	(31)
+#define PACKED_MAX_BITS_PER_NODE	(CHAR_MASK_LENGTH + PACKED_MAX_INDEX_BITS + END_MASK_LENGTH + WORD_MASK_LENGTH)
 
-/* FOR NON-COMPRESSED DAWG */
-/*
+/* FOR NON-COMPRESSED DAWG, the layout of Word-List.dat written by dawggenerator (see dawgformat.h). Large
+   graphs have 64-bit nodes with the same letter and flags and the index in the upper half. */
 #define BYTES_PER_NODE		(4)
-#define KChildBitShift		(8)
-#define KChildIndexMask		(0x0FFFFF00)
-#define KLetterMask			(0x000000FF)
-#define KEndOfWordFlag		(0x20000000)
-#define KEndOfListFlag		(0x10000000)
+#define BYTES_PER_WIDE_NODE	(8)
+#define NODE_CHILD_SHIFT	(DAWG32_INDEX_SHIFT)
+#define NODE_CHILD_MASK		(((1 << DAWG32_INDEX_BITS) - 1) << DAWG32_INDEX_SHIFT)
+#define NODE_LETTER_MASK	((1 << DAWG32_LETTER_BITS) - 1)
+#define NODE_WORD_FLAG		(1 << DAWG32_END_OF_WORD_BIT)
+#define NODE_END_FLAG		(1 << DAWG32_END_OF_LIST_BIT)
+
+/**
+    packed_dawg
+
+    Random access view of a packed file, filled by packed_open.
+*/
+typedef struct
+{
+    const unsigned char* bits;
+    size_t bits_size;
+    int nbr_nodes;
+    int bits_per_node;
+    int letter_bits;
+    int bits_for_index;
+    uint64_t node_mask;
+    uint64_t letter_mask;
+    uint64_t index_mask;
+    uint64_t word_flag;
+    uint64_t end_flag;
+    int alphabet_size;
+    // letters[code] is the letter with given code, codes[letter] the code of the letter or -1
+    int letters[256];
+    int codes[256];
+} packed_dawg;
+
+int packed_open(packed_dawg* dawg, const char* in, size_t in_size);
+
+static inline uint64_t load_le64(const unsigned char* in)
+{
+    uint64_t word;
+    memcpy(&word, in, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+static inline void store_le64(unsigned char* out, uint64_t word)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    memcpy(out, &word, sizeof(word));
+}
+
+/**
+    packed_node
+
+    Returns node number index, use the masks of the dawg to take it apart.
 */
+static inline uint64_t packed_node(const packed_dawg* dawg, uint32_t index)
+{
+    uint64_t bit = (uint64_t)index * dawg->bits_per_node;
+    return (load_le64(dawg->bits + (bit >> 3)) >> (bit & 7)) & dawg->node_mask;
+}
 
-char* encode(char* in, size_t in_size, size_t* out_size);
-char* decode(char* in, size_t in_size, size_t* out_size);
+static inline int packed_letter(const packed_dawg* dawg, uint64_t node)
+{
+    return dawg->letters[node & dawg->letter_mask];
+}
+
+static inline uint32_t packed_child(const packed_dawg* dawg, uint64_t node)
+{
+    return (uint32_t)((node >> dawg->letter_bits) & dawg->index_mask);
+}
+
+/**
+    unpacked_node
+
+    Converts a packed node back to a node of the non-compressed DAWG.
+*/
+static inline int unpacked_node(const packed_dawg* dawg, uint64_t node)
+{
+    int result = (int)(packed_child(dawg, node) << NODE_CHILD_SHIFT) | packed_letter(dawg, node);
+    if (node & dawg->word_flag) result |= NODE_WORD_FLAG;
+    if (node & dawg->end_flag) result |= NODE_END_FLAG;
+    return result;
+}
+
+/**
+    unpacked_wide_node
+
+    Converts a packed node back to a 64-bit node of the non-compressed DAWG, for graphs whose index doesn't
+    fit in the 32-bit nodes.
+*/
+static inline int64_t unpacked_wide_node(const packed_dawg* dawg, uint64_t node)
+{
+    int64_t result = (int64_t)packed_child(dawg, node) << DAWG64_INDEX_SHIFT | packed_letter(dawg, node);
+    if (node & dawg->word_flag) result |= NODE_WORD_FLAG;
+    if (node & dawg->end_flag) result |= NODE_END_FLAG;
+    return result;
+}
+
+/**
+    codec_kernel
+
+    Kernels converting between the two formats: the scalar loops handle one node at a time, the others
+    many nodes per iteration. The results are the same for all of them.
+*/
+typedef enum
+{
+    CODEC_SCALAR,
+    CODEC_BMI2,
+    CODEC_AVX2
+} codec_kernel;
+
+int codec_supported(codec_kernel kernel);
+codec_kernel best_codec_kernel(void);
+
+char* encode_with(codec_kernel kernel, const char* in, size_t in_size, size_t* out_size);
+char* decode_with(codec_kernel kernel, const char* in, size_t in_size, size_t* out_size);
+
+char* encode(const char* in, size_t in_size, size_t* out_size);
+char* decode(const char* in, size_t in_size, size_t* out_size);
 
 char* read_file(const char* filename, long* size);
 void trim(char *line);
 
-#endif
\ No newline at end of file
+#ifdef __cplusplus
+}
+#endif
+
+#endif
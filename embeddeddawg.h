@@ -0,0 +1,137 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef EMBEDDEDDAWG_H
+#define EMBEDDEDDAWG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "nodeformat.h"
+
+/**
+ * DAWG compiled into the program. dawggenerator --embed NAME writes Word-List.h with the nodes of Word-List.dat
+ * as a constexpr array of 32-bit words and an EmbeddedDawg over them:
+ *
+ *     #include "Word-List.h"
+ *
+ *     bool valid = NAME::KDawg.contains("TOP", 3);
+ *     static_assert(NAME::KDawg.contains("TO", 2), "Dictionary has no TO");
+ *
+ * The array is placed in read-only data, so it's shared by every process running the program, and the lookups
+ * need no file, no parsing and no allocation. Everything here is in the header, so the program doesn't link
+ * the dawg library. The lookups are constexpr and can also be evaluated by the compiler; they scan every list
+ * one node at a time, like the scalar kernel of Dawg.
+ *
+ * The constants have internal linkage, so the generated header should be included in one translation unit
+ * only, or every unit gets its own copy of the nodes.
+ */
+
+// Reads the node at given position from the words holding the nodes. 64-bit nodes take two words, the low one
+// first, like in Word-List.dat. They are not written as 64-bit constants because GCC takes quadratic time to
+// compile long arrays of them when many of them share their low half, as the nodes do.
+template <class Node, size_t Words = sizeof(Node) / sizeof(uint32_t)>
+struct EmbeddedNodeReader;
+
+template <class Node>
+struct EmbeddedNodeReader<Node, 1>
+{
+    static constexpr Node read(const uint32_t *words, int position) {
+        return static_cast<Node>(words[position]);
+    }
+};
+
+template <class Node>
+struct EmbeddedNodeReader<Node, 2>
+{
+    static constexpr Node read(const uint32_t *words, int position) {
+        return static_cast<Node>(static_cast<uint64_t>(words[2 * position + 1]) << 32 | words[2 * position]);
+    }
+};
+
+template <class Format>
+class EmbeddedDawg
+{
+public:
+    typedef typename Format::Node Node;
+
+    // The nodes include the empty node 0, like the nodes section of Word-List.dat.
+    constexpr EmbeddedDawg(const uint32_t *words, size_t nodeCount) :
+        mWords(words),
+        mNodeCount(nodeCount)
+    {
+    }
+
+    constexpr bool contains(const char *word, size_t length) const {
+        return isWord(findNode(word, length));
+    }
+
+    bool contains(const std::string &word) const {
+        return contains(word.data(), word.length());
+    }
+
+    // Every word starts with an empty prefix, so it's true for an empty prefix unless the DAWG is empty.
+    constexpr bool hasPrefix(const char *prefix, size_t length) const {
+        return length == 0 ? mNodeCount > 1 : findNode(prefix, length) != 0;
+    }
+
+    bool hasPrefix(const std::string &prefix) const {
+        return hasPrefix(prefix.data(), prefix.length());
+    }
+
+    constexpr Node node(int position) const {
+        return EmbeddedNodeReader<Node>::read(mWords, position);
+    }
+
+    constexpr size_t nodeCount() const {
+        return mNodeCount;
+    }
+
+private:
+    // The walk is written as tail calls, which the compiler turns into loops, because a constexpr function
+    // cannot have loops in C++11.
+
+    // Returns the node for the last letter of the word, or 0 if the DAWG doesn't contain such path.
+    constexpr int findNode(const char *word, size_t length) const {
+        return length == 0 || mNodeCount < 2 ? 0 : findInList(1, word, length);
+    }
+
+    constexpr int findInList(int list, const char *word, size_t length) const {
+        return list == 0 ? 0 : followNode(scanList(list, static_cast<unsigned char>(word[0])), word, length);
+    }
+
+    constexpr int followNode(int position, const char *word, size_t length) const {
+        return position == 0 || length == 1 ? position :
+               findInList(Format::firstChild(node(position)), word + 1, length - 1);
+    }
+
+    // Returns the position of the node with given letter in the list going on from given position, or 0 if
+    // there is no such node.
+    constexpr int scanList(int position, int letter) const {
+        return Format::letter(node(position)) == letter ? position :
+               Format::isEndOfList(node(position)) ? 0 : scanList(position + 1, letter);
+    }
+
+    constexpr bool isWord(int position) const {
+        return position != 0 && Format::isEndOfWord(node(position));
+    }
+
+    const uint32_t *mWords;
+    size_t mNodeCount;
+};
+
+#endif
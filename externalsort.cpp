@@ -0,0 +1,157 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "externalsort.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <ios>
+#include <stdexcept>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+    const size_t KMinMemoryBudget = 1 << 20;
+    // Used to split the budget between the text of the words and their index
+    const size_t KExpectedWordLength = 8;
+
+    class ByWord
+    {
+    public:
+        explicit ByWord(const vector<char> &buffer) : mBuffer(buffer) {}
+
+        bool operator()(const pair<size_t, size_t> &one, const pair<size_t, size_t> &other) const {
+            return Word(&mBuffer[0] + one.first, one.second) < Word(&mBuffer[0] + other.first, other.second);
+        }
+
+    private:
+        const vector<char> &mBuffer;
+    };
+}
+
+ExternalSorter::ExternalSorter(const string &tempDirectory, size_t memoryBudget) :
+    mTempDirectory(tempDirectory)
+{
+    if (memoryBudget < KMinMemoryBudget) {
+        throw invalid_argument("Memory budget has to be at least 1 MB");
+    }
+
+    // Both are allocated once, so the sorter never holds more than the budget, not even while they grow
+    size_t entrySize = sizeof(mWords[0]);
+    size_t textSize = memoryBudget / (KExpectedWordLength + entrySize) * KExpectedWordLength;
+    mBuffer.reserve(textSize);
+    mWords.reserve((memoryBudget - textSize) / entrySize);
+}
+
+ExternalSorter::~ExternalSorter() {
+    for (auto run = mRuns.begin(); run != mRuns.end(); ++run) {
+        unlink(run->c_str());
+    }
+}
+
+void ExternalSorter::add(const Word &word) {
+    if (mBuffer.size() + word.length() > mBuffer.capacity() || mWords.size() == mWords.capacity()) {
+        if (mWords.empty()) {
+            throw length_error("Word is longer than the memory budget");
+        }
+        writeRun();
+    }
+    mWords.push_back(make_pair(mBuffer.size(), word.length()));
+    mBuffer.insert(mBuffer.end(), word.begin(), word.end());
+}
+
+void ExternalSorter::finish() {
+    if (!mWords.empty()) {
+        writeRun();
+    }
+    vector<char>().swap(mBuffer);
+    vector<pair<size_t, size_t> >().swap(mWords);
+}
+
+void ExternalSorter::writeRun() {
+    sort(mWords.begin(), mWords.end(), ByWord(mBuffer));
+
+    string fileName = mTempDirectory + "/dawgrun-XXXXXX";
+    int descriptor = mkstemp(&fileName[0]);
+    if (descriptor == -1) {
+        throw ios_base::failure("Cannot create run file in " + mTempDirectory);
+    }
+    close(descriptor);
+    mRuns.push_back(fileName);
+
+    ofstream output(fileName.c_str(), fstream::out | fstream::binary);
+    if (!output.is_open()) {
+        throw ios_base::failure("Cannot open run file " + fileName);
+    }
+
+    Word previous;
+    for (auto i = mWords.begin(); i != mWords.end(); ++i) {
+        Word word(&mBuffer[0] + i->first, i->second);
+        if (i != mWords.begin() && word.compare(previous) == 0) {
+            continue;
+        }
+        output.write(word.data(), word.length());
+        output.put('\n');
+        previous = word;
+    }
+    output.close();
+    if (output.fail()) {
+        throw ios_base::failure("Cannot write run file " + fileName);
+    }
+
+    printf("Written run %d with %d words\n", (int)mRuns.size(), (int)mWords.size());
+    mBuffer.clear();
+    mWords.clear();
+}
+
+RunMerger::RunMerger(const vector<string> &runs) :
+    mHasLastWord(false)
+{
+    for (auto fileName = runs.begin(); fileName != runs.end(); ++fileName) {
+        mRuns.push_back(unique_ptr<Run>(new Run(*fileName)));
+        if (mRuns.back()->mTokenizer.next(mRuns.back()->mCurrent)) {
+            mHeap.push_back(mRuns.size() - 1);
+        }
+    }
+    make_heap(mHeap.begin(), mHeap.end(), ByDescendingCurrentWord(this));
+}
+
+bool RunMerger::next(Word &word) {
+    while (!mHeap.empty()) {
+        pop_heap(mHeap.begin(), mHeap.end(), ByDescendingCurrentWord(this));
+        Run &run = *mRuns[mHeap.back()];
+        Word candidate = run.mCurrent;
+        if (run.mTokenizer.next(run.mCurrent)) {
+            push_heap(mHeap.begin(), mHeap.end(), ByDescendingCurrentWord(this));
+        } else {
+            mHeap.pop_back();
+        }
+
+        // The same word can be in several runs
+        if (!mHasLastWord || candidate.compare(mLastWord) != 0) {
+            mLastWord = candidate;
+            mHasLastWord = true;
+            word = candidate;
+            return true;
+        }
+    }
+    return false;
+}
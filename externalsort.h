@@ -0,0 +1,115 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef EXTERNALSORT_H
+#define EXTERNALSORT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+#include "wordlist.h"
+
+/**
+ * Sorts a stream of words lexicographically with a bounded amount of memory. The budget is split between one
+ * packed buffer for the text of the words and the list of words in it, both reserved up front; whenever either
+ * of them is full the words are sorted and written to a temporary run file, one word per line, without
+ * duplicates. The run files are removed together with the sorter.
+ */
+class ExternalSorter
+{
+public:
+    // Throws std::invalid_argument if the budget is too small to hold a single run.
+    ExternalSorter(const std::string &tempDirectory, size_t memoryBudget);
+    ~ExternalSorter();
+
+    // Throws std::ios_base::failure if a run cannot be written and std::length_error if the word alone doesn't
+    // fit in the budget.
+    void add(const Word &word);
+
+    // Writes the words added since the last run. Has to be called before the runs are merged.
+    void finish();
+
+    const std::vector<std::string>& runs() const {
+        return mRuns;
+    }
+
+private:
+    ExternalSorter(const ExternalSorter&);
+    ExternalSorter& operator=(const ExternalSorter&);
+
+    void writeRun();
+
+    std::string mTempDirectory;
+
+    // Words point into mBuffer only once the run is complete, so while it grows they are kept as offsets.
+    std::vector<char> mBuffer;
+    std::vector<std::pair<size_t, size_t> > mWords;
+
+    std::vector<std::string> mRuns;
+};
+
+/**
+ * Merges the sorted runs into one sorted stream of unique words. The runs are memory mapped, so the words
+ * stay valid as long as the merger exists.
+ */
+class RunMerger
+{
+public:
+    // Throws std::ios_base::failure if a run cannot be opened.
+    explicit RunMerger(const std::vector<std::string> &runs);
+
+    // Returns false when all runs are exhausted.
+    bool next(Word &word);
+
+private:
+    struct Run {
+        explicit Run(const std::string &fileName) :
+            mFile(fileName.c_str()),
+            mTokenizer(mFile.data(), mFile.data() + mFile.size())
+        {
+        }
+
+        MappedFile mFile;
+        WordTokenizer mTokenizer;
+        Word mCurrent;
+    };
+
+    class ByDescendingCurrentWord
+    {
+    public:
+        explicit ByDescendingCurrentWord(const RunMerger *merger) : mMerger(merger) {}
+
+        bool operator()(size_t one, size_t other) const {
+            return mMerger->mRuns[other]->mCurrent < mMerger->mRuns[one]->mCurrent;
+        }
+
+    private:
+        const RunMerger *mMerger;
+    };
+
+    RunMerger(const RunMerger&);
+    RunMerger& operator=(const RunMerger&);
+
+    std::vector<std::unique_ptr<Run> > mRuns;
+    // Heap of the runs which still have words, with the smallest current word on top.
+    std::vector<size_t> mHeap;
+    Word mLastWord;
+    bool mHasLastWord;
+};
+
+#endif
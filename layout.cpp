@@ -0,0 +1,286 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "layout.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "dawg.h"
+
+using namespace std;
+
+namespace {
+    const size_t KCacheLineSize = 64;
+    const size_t KPageSize = 4096;
+    const unsigned int KNoRun = 0xFFFFFFFF;
+
+    /**
+     * Runs of the encoded nodes and the spanning tree in which every run is a child of the run that reaches
+     * it first in breadth first order.
+     */
+    class Runs
+    {
+    public:
+        explicit Runs(const vector<int64_t> &encodedNodes) :
+            mNodes(encodedNodes),
+            mRunOf(encodedNodes.size() + 1, KNoRun)
+        {
+            for (int position = 1; position <= (int)encodedNodes.size(); ++position) {
+                if (position == 1 || WideNodeFormat::isEndOfList(node(position - 1))) {
+                    mBegin.push_back(position);
+                }
+                mRunOf[position] = mBegin.size() - 1;
+            }
+
+            mTreeChildren.resize(mBegin.size());
+            vector<bool> visited(mBegin.size(), false);
+            if (!mBegin.empty()) {
+                mBreadthFirst.push_back(0);
+                visited[0] = true;
+            }
+            for (size_t i = 0; i != mBreadthFirst.size(); ++i) {
+                unsigned int run = mBreadthFirst[i];
+                for (int position = mBegin[run]; position != end(run); ++position) {
+                    int firstChild = WideNodeFormat::firstChild(node(position));
+                    if (firstChild != 0 && !visited[mRunOf[firstChild]]) {
+                        visited[mRunOf[firstChild]] = true;
+                        mBreadthFirst.push_back(mRunOf[firstChild]);
+                        mTreeChildren[run].push_back(mRunOf[firstChild]);
+                    }
+                }
+            }
+        }
+
+        size_t count() const {
+            return mBegin.size();
+        }
+
+        int64_t node(int position) const {
+            return mNodes[position - 1];
+        }
+
+        int begin(unsigned int run) const {
+            return mBegin[run];
+        }
+
+        int end(unsigned int run) const {
+            return run + 1 == mBegin.size() ? mNodes.size() + 1 : mBegin[run + 1];
+        }
+
+        unsigned int runOf(int position) const {
+            return mRunOf[position];
+        }
+
+        const vector<unsigned int>& breadthFirst() const {
+            return mBreadthFirst;
+        }
+
+        const vector<unsigned int>& treeChildren(unsigned int run) const {
+            return mTreeChildren[run];
+        }
+
+    private:
+        const vector<int64_t> &mNodes;
+        vector<int> mBegin;
+        vector<unsigned int> mRunOf;
+        vector<unsigned int> mBreadthFirst;
+        vector<vector<unsigned int> > mTreeChildren;
+    };
+
+    // Number of levels of the subtree of the spanning tree below every run.
+    vector<int> treeHeights(const Runs &runs) {
+        vector<int> heights(runs.count(), 1);
+        const vector<unsigned int> &order = runs.breadthFirst();
+        for (auto run = order.rbegin(); run != order.rend(); ++run) {
+            const vector<unsigned int> &children = runs.treeChildren(*run);
+            for (auto child = children.begin(); child != children.end(); ++child) {
+                heights[*run] = max(heights[*run], heights[*child] + 1);
+            }
+        }
+        return heights;
+    }
+
+    // Adds the runs at given depth below the run to the result, in depth first order.
+    void collectRunsAtDepth(const Runs &runs, unsigned int run, int depth, vector<unsigned int> &result) {
+        if (depth == 0) {
+            result.push_back(run);
+            return;
+        }
+        const vector<unsigned int> &children = runs.treeChildren(run);
+        for (auto child = children.begin(); child != children.end(); ++child) {
+            collectRunsAtDepth(runs, *child, depth - 1, result);
+        }
+    }
+
+    // Lays out the top levels of the subtree below the run.
+    void blockedOrder(const Runs &runs, unsigned int run, int levels, vector<unsigned int> &order) {
+        if (levels == 1) {
+            order.push_back(run);
+            return;
+        }
+
+        int topLevels = levels / 2;
+        blockedOrder(runs, run, topLevels, order);
+
+        vector<unsigned int> bottomRoots;
+        collectRunsAtDepth(runs, run, topLevels, bottomRoots);
+        for (auto bottomRoot = bottomRoots.begin(); bottomRoot != bottomRoots.end(); ++bottomRoot) {
+            blockedOrder(runs, *bottomRoot, levels - topLevels, order);
+        }
+    }
+
+    // Calls visit(position) for every node read by contains(word), in order.
+    template <class Visitor>
+    void walkLookup(const vector<int64_t> &encodedNodes, const Word &word, Visitor visit) {
+        if (encodedNodes.empty()) {
+            return;
+        }
+        int position = 1;
+        for (size_t i = 0; i != word.length(); ++i) {
+            int64_t node;
+            for (;; ++position) {
+                node = encodedNodes[position - 1];
+                visit(position);
+                if (WideNodeFormat::letter(node) == static_cast<unsigned char>(word[i])) {
+                    break;
+                }
+                if (WideNodeFormat::isEndOfList(node)) {
+                    return;
+                }
+            }
+            position = WideNodeFormat::firstChild(node);
+            if (position == 0) {
+                return;
+            }
+        }
+    }
+
+    vector<unsigned int> frequencyOrder(const vector<int64_t> &encodedNodes, const Runs &runs, const vector<Word> &sample) {
+        if (sample.empty()) {
+            throw invalid_argument("Frequency layout needs a query sample");
+        }
+
+        vector<size_t> visits(runs.count(), 0);
+        for (auto word = sample.begin(); word != sample.end(); ++word) {
+            unsigned int lastRun = KNoRun;
+            walkLookup(encodedNodes, *word, [&](int position) {
+                unsigned int run = runs.runOf(position);
+                if (run != lastRun) {
+                    ++visits[run];
+                    lastRun = run;
+                }
+            });
+        }
+
+        // Root first, then by descending visits. Runs that are never visited keep breadth first order.
+        vector<unsigned int> order = runs.breadthFirst();
+        stable_sort(order.begin() + 1, order.end(), [&visits](unsigned int one, unsigned int other) {
+            return visits[one] > visits[other];
+        });
+        return order;
+    }
+}
+
+NodeLayout parseNodeLayout(const char *name) {
+    string layout(name);
+    if (layout == "builder") {
+        return KBuilderLayout;
+    } else if (layout == "bfs") {
+        return KBreadthFirstLayout;
+    } else if (layout == "veb") {
+        return KBlockedLayout;
+    } else if (layout == "frequency") {
+        return KFrequencyLayout;
+    }
+    throw invalid_argument("Unknown layout " + layout + ", expected builder, bfs, veb or frequency");
+}
+
+vector<int64_t> layoutNodes(const vector<int64_t> &encodedNodes, NodeLayout layout, const vector<Word> &sample) {
+    if (layout == KBuilderLayout || encodedNodes.empty()) {
+        return encodedNodes;
+    }
+
+    Runs runs(encodedNodes);
+    vector<unsigned int> order;
+    switch (layout) {
+    case KBreadthFirstLayout:
+        order = runs.breadthFirst();
+        break;
+    case KBlockedLayout:
+        blockedOrder(runs, 0, treeHeights(runs)[0], order);
+        break;
+    default:
+        order = frequencyOrder(encodedNodes, runs, sample);
+        break;
+    }
+
+    // Runs that no list points to anymore are not reachable from the root and are dropped
+    vector<int> newBegin(runs.count(), 0);
+    int nextPosition = 1;
+    for (auto run = order.begin(); run != order.end(); ++run) {
+        newBegin[*run] = nextPosition;
+        nextPosition += runs.end(*run) - runs.begin(*run);
+    }
+
+    vector<int64_t> result;
+    result.reserve(nextPosition - 1);
+    for (auto run = order.begin(); run != order.end(); ++run) {
+        for (int position = runs.begin(*run); position != runs.end(*run); ++position) {
+            int64_t node = runs.node(position);
+            int firstChild = WideNodeFormat::firstChild(node);
+            if (firstChild != 0) {
+                unsigned int childRun = runs.runOf(firstChild);
+                firstChild = newBegin[childRun] + (firstChild - runs.begin(childRun));
+                node = WideNodeFormat::withFirstChild(node, firstChild);
+            }
+            result.push_back(node);
+        }
+    }
+    return result;
+}
+
+LayoutStatistics measureLayout(const vector<int64_t> &encodedNodes, const vector<Word> &queries) {
+    LayoutStatistics result = { 0, 0 };
+    if (queries.empty()) {
+        return result;
+    }
+
+    size_t nodeSize = dawg_node_size_for(encodedNodes.size() + 1);
+    vector<size_t> lines;
+    vector<size_t> pages;
+    size_t totalLines = 0;
+    size_t totalPages = 0;
+    for (auto word = queries.begin(); word != queries.end(); ++word) {
+        lines.clear();
+        pages.clear();
+        walkLookup(encodedNodes, *word, [&](int position) {
+            // Offset in the nodes section, which starts at a cache line
+            size_t offset = position * nodeSize;
+            lines.push_back(offset / KCacheLineSize);
+            pages.push_back(offset / KPageSize);
+        });
+        sort(lines.begin(), lines.end());
+        sort(pages.begin(), pages.end());
+        totalLines += unique(lines.begin(), lines.end()) - lines.begin();
+        totalPages += unique(pages.begin(), pages.end()) - pages.begin();
+    }
+    result.mCacheLinesPerLookup = (double)totalLines / queries.size();
+    result.mPagesPerLookup = (double)totalPages / queries.size();
+    return result;
+}
@@ -0,0 +1,60 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <cstdint>
+#include <vector>
+
+#include "wordlist.h"
+
+/**
+ * Orders of the encoded nodes. The unit of every layout is a run: consecutive nodes up to the one with
+ * End-Of-List flag. Lists of children are runs or tails of runs shared with longer lists, so moving whole
+ * runs keeps every list continuous. The run with the root list always stays first.
+ */
+enum NodeLayout {
+    // Order produced by the builder
+    KBuilderLayout,
+    // Runs in breadth first order, so the top levels of the graph are packed together
+    KBreadthFirstLayout,
+    // van Emde Boas order of the breadth first spanning tree of runs: the tree is split at half of its
+    // height and the top part and every bottom subtree are laid out recursively one after another, so every
+    // path crosses few cache lines and pages regardless of their size
+    KBlockedLayout,
+    // Runs visited most often by the lookups of a query sample go first
+    KFrequencyLayout
+};
+
+// Throws std::invalid_argument for an unknown name.
+NodeLayout parseNodeLayout(const char *name);
+
+// Nodes are encoded in WideNodeFormat (see nodeformat.h), without the empty node 0, so the node at position
+// p of the file is encodedNodes[p - 1]. The sample is only used by KFrequencyLayout.
+std::vector<int64_t> layoutNodes(const std::vector<int64_t> &encodedNodes, NodeLayout layout,
+                                 const std::vector<Word> &sample);
+
+struct LayoutStatistics {
+    double mCacheLinesPerLookup;
+    double mPagesPerLookup;
+};
+
+// Average number of distinct cache lines and pages of Word-List.dat touched by contains() of each query, with
+// the nodes as wide as they are written.
+LayoutStatistics measureLayout(const std::vector<int64_t> &encodedNodes, const std::vector<Word> &queries);
+
+#endif
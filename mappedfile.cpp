@@ -0,0 +1,63 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mappedfile.h"
+
+#include <ios>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+MappedFile::MappedFile(const char *fileName, AccessPattern accessPattern) :
+    mData(NULL),
+    mSize(0)
+{
+    int descriptor = open(fileName, O_RDONLY);
+    if (descriptor == -1) {
+        throw ios_base::failure(string("Cannot open ") + fileName);
+    }
+
+    struct stat fileStatus;
+    if (fstat(descriptor, &fileStatus) == -1) {
+        close(descriptor);
+        throw ios_base::failure(string("Cannot read size of ") + fileName);
+    }
+    mSize = fileStatus.st_size;
+
+    // mmap refuses empty mappings, but an empty file is still a valid file
+    if (mSize != 0) {
+        void *mapping = mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapping == MAP_FAILED) {
+            close(descriptor);
+            throw ios_base::failure(string("Cannot map ") + fileName);
+        }
+        madvise(mapping, mSize, accessPattern == KSequentialAccess ? MADV_SEQUENTIAL : MADV_RANDOM);
+        mData = static_cast<const char*>(mapping);
+    }
+    close(descriptor);
+}
+
+MappedFile::~MappedFile() {
+    if (mData != NULL) {
+        munmap(const_cast<char*>(mData), mSize);
+    }
+}
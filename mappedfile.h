@@ -0,0 +1,54 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+
+/**
+ * Read-only memory mapping of a whole file. The mapping is shared with the page cache, so opening even
+ * a large file costs only a few system calls, and the pages are read from disk when they're touched.
+ */
+class MappedFile
+{
+public:
+    enum AccessPattern {
+        KSequentialAccess,
+        KRandomAccess
+    };
+
+    // Throws std::ios_base::failure if the file cannot be opened or mapped.
+    explicit MappedFile(const char *fileName, AccessPattern accessPattern = KSequentialAccess);
+    ~MappedFile();
+
+    const char* data() const {
+        return mData;
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char *mData;
+    size_t mSize;
+};
+
+#endif
@@ -0,0 +1,303 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NODEFORMAT_H
+#define NODEFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "dawgformat.h"
+#include "dawgminify.h"
+
+/**
+ * Layout of the nodes of Word-List.dat, described by the header of the file (see dawgformat.h): a node holds
+ * its letter in the lowest LetterBits bits, the index of its first child in IndexBits bits from IndexShift (0
+ * if it has no children), and the End-Of-List and End-Of-Word flags. Every layout is a separate type with the
+ * masks and shifts as compile-time constants, and the encoder, the queries and the iterators are instantiated
+ * for every one of them, so their loops never check the layout of a node. The lookups in the packed
+ * nodes of Word-List.packed are instantiated for every letter width with PackedNodeFormat below.
+ */
+template <class NodeType, int LetterBits, int IndexShift, int IndexBits, int EndOfListBit, int EndOfWordBit>
+struct NodeFormat
+{
+    typedef NodeType Node;
+    typedef typename std::make_unsigned<Node>::type Bits;
+
+    static const int KLetterBits = LetterBits;
+    static const int KIndexShift = IndexShift;
+    static const int KIndexBits = IndexBits;
+    static const int KEndOfListBit = EndOfListBit;
+    static const int KEndOfWordBit = EndOfWordBit;
+
+    static const Bits KLetterMask = (static_cast<Bits>(1) << LetterBits) - 1;
+    static const Bits KIndexMask = ((static_cast<Bits>(1) << IndexBits) - 1) << IndexShift;
+    static const Bits KEndOfListFlag = static_cast<Bits>(1) << EndOfListBit;
+    static const Bits KEndOfWordFlag = static_cast<Bits>(1) << EndOfWordBit;
+
+    // Number of nodes, including the empty node 0, that the index can address. The readers address nodes
+    // with signed 32-bit ints, which limits the wider indices.
+    static const uint64_t KMaxNodeCount = IndexBits < 31 ? static_cast<uint64_t>(1) << IndexBits : 0x7FFFFFFF;
+
+    static_assert(LetterBits > 0 && IndexShift >= LetterBits && IndexShift + IndexBits <= 8 * static_cast<int>(sizeof(Node)) &&
+                  EndOfListBit >= LetterBits && (EndOfListBit < IndexShift || EndOfListBit >= IndexShift + IndexBits) &&
+                  EndOfWordBit >= LetterBits && (EndOfWordBit < IndexShift || EndOfWordBit >= IndexShift + IndexBits) &&
+                  EndOfListBit != EndOfWordBit && EndOfListBit < 8 * static_cast<int>(sizeof(Node)) &&
+                  EndOfWordBit < 8 * static_cast<int>(sizeof(Node)), "Fields of the node overlap");
+
+    static constexpr int letter(Node node) {
+        return static_cast<int>(static_cast<Bits>(node) & KLetterMask);
+    }
+
+    static constexpr int firstChild(Node node) {
+        return static_cast<int>((static_cast<Bits>(node) & KIndexMask) >> IndexShift);
+    }
+
+    static constexpr bool isEndOfWord(Node node) {
+        return (static_cast<Bits>(node) & KEndOfWordFlag) != 0;
+    }
+
+    static constexpr bool isEndOfList(Node node) {
+        return (static_cast<Bits>(node) & KEndOfListFlag) != 0;
+    }
+
+    static constexpr Node encode(int letter, int firstChild, bool endOfWord, bool endOfList) {
+        return static_cast<Node>(static_cast<Bits>(letter) | static_cast<Bits>(firstChild) << IndexShift |
+                                 (endOfWord ? KEndOfWordFlag : 0) | (endOfList ? KEndOfListFlag : 0));
+    }
+
+    // The node with its first child replaced.
+    static constexpr Node withFirstChild(Node node, int firstChild) {
+        return static_cast<Node>((static_cast<Bits>(node) & ~KIndexMask) | static_cast<Bits>(firstChild) << IndexShift);
+    }
+
+    // The node of another format in this one. The index has to fit.
+    template <class Other>
+    static constexpr Node from(typename Other::Node node) {
+        return encode(Other::letter(node), Other::firstChild(node), Other::isEndOfWord(node), Other::isEndOfList(node));
+    }
+
+    static void initHeader(dawg_header *header, uint64_t nodeCount) {
+        dawg_header_init(header, DAWG_FORMAT_WORDS, nodeCount);
+        header->bits_per_node = 8 * sizeof(Node);
+        header->letter_bits = LetterBits;
+        header->letter_shift = 0;
+        header->index_bits = IndexBits;
+        header->index_shift = IndexShift;
+        header->end_of_word_bit = EndOfWordBit;
+        header->end_of_list_bit = EndOfListBit;
+    }
+
+    static bool matches(const dawg_header &header) {
+        return header.node_format == DAWG_FORMAT_WORDS && header.bits_per_node == 8 * sizeof(Node) &&
+               header.letter_bits == LetterBits && header.letter_shift == 0 && header.index_bits == IndexBits &&
+               header.index_shift == IndexShift && header.end_of_word_bit == EndOfWordBit &&
+               header.end_of_list_bit == EndOfListBit && header.alphabet_size == 0;
+    }
+};
+
+typedef NodeFormat<int32_t, DAWG32_LETTER_BITS, DAWG32_INDEX_SHIFT, DAWG32_INDEX_BITS,
+                   DAWG32_END_OF_LIST_BIT, DAWG32_END_OF_WORD_BIT> NarrowNodeFormat;
+
+/**
+ * Graphs with more nodes than the 32-bit nodes can address are stored as 64-bit nodes, picked when the file is
+ * written. The letter and the flags are in the same bits as in the 32-bit nodes and the index takes the upper
+ * half. The generator keeps every graph in this format until it's written.
+ */
+typedef NodeFormat<int64_t, DAWG32_LETTER_BITS, DAWG64_INDEX_SHIFT, DAWG64_INDEX_BITS,
+                   DAWG32_END_OF_LIST_BIT, DAWG32_END_OF_WORD_BIT> WideNodeFormat;
+
+static_assert(NarrowNodeFormat::KMaxNodeCount == DAWG32_MAX_NODE_COUNT &&
+              WideNodeFormat::KMaxNodeCount == DAWG64_MAX_NODE_COUNT, "Node formats don't match dawgformat.h");
+
+/**
+ * Picks the format of the list for a file or a graph and calls visitor.visit<Format>(), which instantiates
+ * the work of the visitor for every format of the list. The formats go from the narrowest one.
+ */
+template <class... Formats>
+struct NodeFormatList;
+
+template <>
+struct NodeFormatList<>
+{
+    template <class Visitor>
+    static bool dispatch(const dawg_header& /*header*/, Visitor& /*visitor*/) {
+        return false;
+    }
+
+    template <class Visitor>
+    static bool dispatchNarrowest(uint64_t /*nodeCount*/, Visitor& /*visitor*/) {
+        return false;
+    }
+};
+
+template <class Format, class... Formats>
+struct NodeFormatList<Format, Formats...>
+{
+    // Visits the format described by the header. Returns false if it's none of the list.
+    template <class Visitor>
+    static bool dispatch(const dawg_header &header, Visitor &visitor) {
+        if (Format::matches(header)) {
+            visitor.template visit<Format>();
+            return true;
+        }
+        return NodeFormatList<Formats...>::dispatch(header, visitor);
+    }
+
+    // Visits the narrowest format that can address given number of nodes, including the empty node 0.
+    // Returns false if none of the list can.
+    template <class Visitor>
+    static bool dispatchNarrowest(uint64_t nodeCount, Visitor &visitor) {
+        if (nodeCount <= Format::KMaxNodeCount) {
+            visitor.template visit<Format>();
+            return true;
+        }
+        return NodeFormatList<Formats...>::dispatchNarrowest(nodeCount, visitor);
+    }
+};
+
+typedef NodeFormatList<NarrowNodeFormat, WideNodeFormat> SupportedNodeFormats;
+
+/**
+ * Writes Word-List.dat with the nodes converted from the format they are built in to Format. The empty node 0
+ * is written before the given nodes, and the word counts, if not NULL, hold one count per node including node
+ * 0. Returns false if the file cannot be written or the nodes don't fit in Format.
+ */
+template <class Format, class From>
+bool writeNodeFile(const char *fileName, const std::vector<typename From::Node> &nodes, const uint32_t *wordCounts) {
+    if (nodes.size() + 1 > Format::KMaxNodeCount) {
+        return false;
+    }
+
+    std::vector<typename Format::Node> converted;
+    converted.reserve(nodes.size() + 1);
+    converted.push_back(0);
+    for (auto node = nodes.begin(); node != nodes.end(); ++node) {
+        converted.push_back(Format::template from<From>(*node));
+    }
+
+    dawg_header header;
+    Format::initHeader(&header, converted.size());
+    return dawg_write_file(fileName, &header, converted.data(), wordCounts) != 0;
+}
+
+/**
+ * Visitor writing the nodes with writeNodeFile() in the format picked by NodeFormatList::dispatchNarrowest().
+ */
+template <class From>
+class NodeFileWriter
+{
+public:
+    NodeFileWriter(const char *fileName, const std::vector<typename From::Node> &nodes,
+                   const uint32_t *wordCounts) :
+        mFileName(fileName),
+        mNodes(nodes),
+        mWordCounts(wordCounts),
+        mWritten(false),
+        mNodeSize(0)
+    {
+    }
+
+    template <class Format>
+    void visit() {
+        mWritten = writeNodeFile<Format, From>(mFileName, mNodes, mWordCounts);
+        mNodeSize = sizeof(typename Format::Node);
+    }
+
+    bool written() const {
+        return mWritten;
+    }
+
+    size_t nodeSize() const {
+        return mNodeSize;
+    }
+
+private:
+    const char *mFileName;
+    const std::vector<typename From::Node> &mNodes;
+    const uint32_t *mWordCounts;
+    bool mWritten;
+    size_t mNodeSize;
+};
+
+/**
+ * Layout of the packed nodes of Word-List.packed (see dawgminify.h) with LetterBits bits of the letter code,
+ * followed by the index of the first child and the End-Of-List and the End-Of-Word flags. The letter width
+ * is a compile-time constant, so the letter code is compared and the index found with constant masks and
+ * shifts; the index width, which depends on the node count, comes from the packed_dawg of the file.
+ */
+template <int LetterBits>
+struct PackedNodeFormat
+{
+    static const int KLetterBits = LetterBits;
+    static const uint64_t KLetterMask = (static_cast<uint64_t>(1) << LetterBits) - 1;
+
+    static_assert(LetterBits > 0 && LetterBits <= CHAR_MASK_LENGTH, "Letter code doesn't fit in a byte");
+
+    // Node number position of the packed file.
+    static uint64_t node(const packed_dawg &packed, uint32_t position) {
+        return packed_node(&packed, position);
+    }
+
+    static constexpr int letterCode(uint64_t node) {
+        return static_cast<int>(node & KLetterMask);
+    }
+
+    static int firstChild(const packed_dawg &packed, uint64_t node) {
+        return static_cast<int>((node >> LetterBits) & packed.index_mask);
+    }
+
+    static bool isEndOfList(const packed_dawg &packed, uint64_t node) {
+        return (node & packed.end_flag) != 0;
+    }
+
+    static bool matches(const packed_dawg &packed) {
+        return packed.letter_bits == LetterBits;
+    }
+};
+
+/**
+ * Picks the PackedNodeFormat with the letter width of a packed file, going down from LetterBits, and calls
+ * visitor.visit<Format>(). Returns false for letter codes which take no bits, in single-letter graphs.
+ */
+template <int LetterBits>
+struct PackedNodeFormats
+{
+    template <class Visitor>
+    static bool dispatch(const packed_dawg &packed, Visitor &visitor) {
+        if (PackedNodeFormat<LetterBits>::matches(packed)) {
+            visitor.template visit<PackedNodeFormat<LetterBits> >();
+            return true;
+        }
+        return PackedNodeFormats<LetterBits - 1>::dispatch(packed, visitor);
+    }
+};
+
+template <>
+struct PackedNodeFormats<0>
+{
+    template <class Visitor>
+    static bool dispatch(const packed_dawg& /*packed*/, Visitor& /*visitor*/) {
+        return false;
+    }
+};
+
+// Every letter width encode() picks, for alphabets of up to 256 letters.
+typedef PackedNodeFormats<CHAR_MASK_LENGTH> SupportedPackedNodeFormats;
+
+#endif
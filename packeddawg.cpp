@@ -0,0 +1,191 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "packeddawg.h"
+
+#include <ios>
+
+using namespace std;
+
+class PackedDawg::NodeFinderSelector
+{
+public:
+    explicit NodeFinderSelector(PackedDawg &dawg) :
+        mDawg(dawg)
+    {
+    }
+
+    template <class Format>
+    void visit() {
+        mDawg.mFindNode = findNode<Format>;
+    }
+
+private:
+    PackedDawg &mDawg;
+};
+
+PackedDawg::PackedDawg(const char *fileName) :
+    mFile(fileName, MappedFile::KRandomAccess),
+    mFindNode(findAnyNode)
+{
+    if (!packed_open(&mPacked, mFile.data(), mFile.size()) || mPacked.nbr_nodes < 1) {
+        throw ios_base::failure(string("Invalid packed DAWG file ") + fileName);
+    }
+    NodeFinderSelector selector(*this);
+    SupportedPackedNodeFormats::dispatch(mPacked, selector);
+}
+
+template <class Format>
+int PackedDawg::findNode(const packed_dawg &packed, const char *word, size_t length) {
+    if (length == 0 || packed.nbr_nodes < 2) {
+        return 0;
+    }
+
+    int position = 1;
+    for (size_t i = 0;; ++i) {
+        int code = packed.codes[static_cast<unsigned char>(word[i])];
+        if (code < 0) {
+            return 0;
+        }
+        // The code is in the lowest bits, so it's compared without shifting the nodes
+        uint64_t node = Format::node(packed, position);
+        while (Format::letterCode(node) != code) {
+            if (Format::isEndOfList(packed, node)) {
+                return 0;
+            }
+            node = Format::node(packed, ++position);
+        }
+        if (i + 1 == length) {
+            return position;
+        }
+        position = Format::firstChild(packed, node);
+        if (position == 0) {
+            return 0;
+        }
+    }
+}
+
+int PackedDawg::scanAnyList(const packed_dawg &packed, int position, int code) {
+    // The code is in the lowest bits, so it's compared without shifting the nodes
+    for (;; ++position) {
+        uint64_t node = packed_node(&packed, position);
+        if ((node & packed.letter_mask) == (uint64_t)code) {
+            return position;
+        }
+        if ((node & packed.end_flag) != 0) {
+            return 0;
+        }
+    }
+}
+
+int PackedDawg::findAnyNode(const packed_dawg &packed, const char *word, size_t length) {
+    if (length == 0 || packed.nbr_nodes < 2) {
+        return 0;
+    }
+
+    int position = 1;
+    for (size_t i = 0;; ++i) {
+        int code = packed.codes[static_cast<unsigned char>(word[i])];
+        if (code < 0) {
+            return 0;
+        }
+        position = scanAnyList(packed, position, code);
+        if (position == 0 || i + 1 == length) {
+            return position;
+        }
+        position = packed_child(&packed, packed_node(&packed, position));
+        if (position == 0) {
+            return 0;
+        }
+    }
+}
+
+PackedCompletionIterator::PackedCompletionIterator(const PackedDawg &dawg, const char *prefix, size_t length,
+                                                   size_t limit) :
+    mDawg(dawg),
+    mRemaining(limit),
+    mPrefixIsWord(false),
+    mDepth(0),
+    mFirstList(0),
+    mWord(prefix, length)
+{
+    if (length == 0) {
+        mFirstList = dawg.nodeCount() > 1 ? 1 : 0;
+    } else {
+        int node = dawg.findNode(prefix, length);
+        if (node != 0) {
+            uint64_t packed = dawg.packedNode(node);
+            mPrefixIsWord = (packed & dawg.mPacked.word_flag) != 0;
+            mFirstList = dawg.firstChild(packed);
+        }
+    }
+}
+
+bool PackedCompletionIterator::next() {
+    if (mRemaining == 0) {
+        return false;
+    }
+
+    if (mPrefixIsWord) {
+        mPrefixIsWord = false;
+        mWord.end(0);
+        --mRemaining;
+        return true;
+    }
+
+    while (advance()) {
+        uint64_t node = mStackNodes[mDepth - 1];
+        mWord.setLetter(mDepth - 1, mDawg.letter(node));
+        if ((node & mDawg.mPacked.word_flag) != 0) {
+            mWord.end(mDepth);
+            --mRemaining;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PackedCompletionIterator::advance() {
+    if (mDepth == 0) {
+        if (mFirstList == 0) {
+            return false;
+        }
+        mWord.requireRoom(mDepth);
+        mStack[mDepth] = mFirstList;
+        mStackNodes[mDepth++] = mDawg.packedNode(mFirstList);
+        mFirstList = 0;
+        return true;
+    }
+
+    int firstChild = mDawg.firstChild(mStackNodes[mDepth - 1]);
+    if (firstChild != 0) {
+        mWord.requireRoom(mDepth);
+        mStack[mDepth] = firstChild;
+        mStackNodes[mDepth++] = mDawg.packedNode(firstChild);
+        return true;
+    }
+
+    // Go to the next brother, or the next brother of the closest ancestor that has one
+    while ((mStackNodes[mDepth - 1] & mDawg.mPacked.end_flag) != 0) {
+        if (--mDepth == 0) {
+            return false;
+        }
+    }
+    int brother = ++mStack[mDepth - 1];
+    mStackNodes[mDepth - 1] = mDawg.packedNode(brother);
+    return true;
+}
@@ -0,0 +1,174 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PACKEDDAWG_H
+#define PACKEDDAWG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+#include "completionword.h"
+#include "dawgminify.h"
+#include "mappedfile.h"
+#include "nodeformat.h"
+
+/**
+ * Read-only DAWG loaded from the output of encode() in dawgminify. The packed nodes are queried where they
+ * are, without decoding them to the 32-bit nodes first, so the process only keeps the smaller file mapped.
+ * Every node is fetched with one unaligned load, a shift and a mask; the letters of the queries are turned
+ * into letter codes once, and the rest of the walk is the same as in Dawg, including the node numbering.
+ * The lookups are instantiated for the letter width of every PackedNodeFormat and the one for the width of
+ * the file is picked when it's opened, so the letter codes are compared with a constant mask.
+ * The packed format has no word counts.
+ */
+class PackedDawg
+{
+public:
+    // Throws std::ios_base::failure if the file cannot be mapped, its sections don't match the header, or
+    // its fields are not in the order described in dawgminify.h.
+    explicit PackedDawg(const char *fileName);
+
+    bool contains(const char *word, size_t length) const {
+        int node = findNode(word, length);
+        return node != 0 && (packedNode(node) & mPacked.word_flag) != 0;
+    }
+
+    bool contains(const std::string &word) const {
+        return contains(word.data(), word.length());
+    }
+
+    // Every word starts with an empty prefix, so it's true for an empty prefix unless the DAWG is empty.
+    bool hasPrefix(const char *prefix, size_t length) const {
+        return length == 0 ? nodeCount() > 1 : findNode(prefix, length) != 0;
+    }
+
+    bool hasPrefix(const std::string &prefix) const {
+        return hasPrefix(prefix.data(), prefix.length());
+    }
+
+    size_t nodeCount() const {
+        return mPacked.nbr_nodes;
+    }
+
+    int bitsPerNode() const {
+        return mPacked.bits_per_node;
+    }
+
+    // Number of different letters in the graph, which is what the width of the letter codes depends on.
+    int alphabetSize() const {
+        return mPacked.alphabet_size;
+    }
+
+    // Size of the mapped file.
+    size_t size() const {
+        return mFile.size();
+    }
+
+private:
+    friend class PackedCompletionIterator;
+
+    PackedDawg(const PackedDawg&);
+    PackedDawg& operator=(const PackedDawg&);
+
+    uint64_t packedNode(int position) const {
+        return packed_node(&mPacked, position);
+    }
+
+    int letter(uint64_t node) const {
+        return packed_letter(&mPacked, node);
+    }
+
+    int firstChild(uint64_t node) const {
+        return packed_child(&mPacked, node);
+    }
+
+    // Returns the node for the last letter of the word, or 0 if the DAWG doesn't contain such path.
+    typedef int (*NodeFinder)(const packed_dawg &packed, const char *word, size_t length);
+
+    // Visitor of SupportedPackedNodeFormats which picks the lookup for the letter width of the file.
+    class NodeFinderSelector;
+
+    int findNode(const char *word, size_t length) const {
+        return mFindNode(mPacked, word, length);
+    }
+
+    template <class Format>
+    static int findNode(const packed_dawg &packed, const char *word, size_t length);
+
+    // Reads the letter width from the packed_dawg, for the files with no PackedNodeFormat.
+    static int findAnyNode(const packed_dawg &packed, const char *word, size_t length);
+
+    // Returns the position of the node with given letter code in the list starting at given position, or 0
+    // if there is no such node.
+    static int scanAnyList(const packed_dawg &packed, int position, int code);
+
+    MappedFile mFile;
+    packed_dawg mPacked;
+    NodeFinder mFindNode;
+};
+
+/**
+ * CompletionIterator for PackedDawg: streams the words starting with given prefix, the prefix itself
+ * included, in the same graph order as CompletionIterator, without allocating anything.
+ */
+class PackedCompletionIterator
+{
+public:
+    static const size_t KMaxWordLength = CompletionWord::KMaxLength;
+
+    // At most limit words are returned. Throws std::length_error if the prefix is longer than KMaxWordLength.
+    PackedCompletionIterator(const PackedDawg &dawg, const char *prefix, size_t length,
+                             size_t limit = std::numeric_limits<size_t>::max());
+
+    // Moves to the next word. Returns false when there are no more words. Throws std::length_error if the
+    // graph contains a word longer than KMaxWordLength.
+    bool next();
+
+    // Null terminated, valid until the next call to next().
+    const char* word() const {
+        return mWord.word();
+    }
+
+    size_t length() const {
+        return mWord.length();
+    }
+
+private:
+    PackedCompletionIterator(const PackedCompletionIterator&);
+    PackedCompletionIterator& operator=(const PackedCompletionIterator&);
+
+    // Moves to the next node in depth first order. Returns false when the whole subgraph below the prefix
+    // is visited.
+    bool advance();
+
+    const PackedDawg &mDawg;
+    size_t mRemaining;
+    bool mPrefixIsWord;
+
+    // mStack[i] is the position of the node for the letter at depth i below the prefix, and mStackNodes[i] is
+    // its packed node, so every node is fetched once. mDepth is 0 before the walk starts and after it's
+    // finished.
+    int mStack[KMaxWordLength];
+    uint64_t mStackNodes[KMaxWordLength];
+    size_t mDepth;
+    int mFirstList;
+
+    CompletionWord mWord;
+};
+
+#endif
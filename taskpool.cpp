@@ -0,0 +1,161 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "taskpool.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+    // Worker index of the current thread in the pool that started it. Threads which don't belong to any
+    // pool (i.e. the thread which created the pool) use the worker 0.
+    thread_local const TaskPool *tCurrentPool = NULL;
+    thread_local unsigned int tCurrentWorker = 0;
+}
+
+TaskPool::TaskPool(unsigned int threadCount) :
+    mQueuedTasks(0),
+    mStopping(false)
+{
+    if (threadCount == 0) {
+        throw invalid_argument("Task pool needs at least one thread");
+    }
+
+    for (unsigned int i = 0; i != threadCount; ++i) {
+        mWorkers.push_back(unique_ptr<Worker>(new Worker()));
+    }
+    for (unsigned int i = 1; i != threadCount; ++i) {
+        mThreads.push_back(thread(&TaskPool::workerLoop, this, i));
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        lock_guard<mutex> lock(mSleepLock);
+        mStopping = true;
+    }
+    mWakeUp.notify_all();
+
+    for (auto i = mThreads.begin(); i != mThreads.end(); ++i) {
+        i->join();
+    }
+}
+
+void TaskPool::spawn(TaskGroup &group, const Task &task) {
+    ++group.mPending;
+
+    Worker &worker = *mWorkers[currentWorker()];
+    {
+        lock_guard<mutex> lock(worker.mLock);
+        QueuedTask queued = { task, &group };
+        worker.mTasks.push_back(queued);
+    }
+    ++mQueuedTasks;
+
+    if (!mThreads.empty()) {
+        // Taking the lock makes sure the sleeping threads either see the new task or get the notification.
+        { lock_guard<mutex> lock(mSleepLock); }
+        mWakeUp.notify_one();
+    }
+}
+
+void TaskPool::wait(TaskGroup &group) {
+    unsigned int worker = currentWorker();
+    while (group.mPending != 0) {
+        if (!runOneTask(worker)) {
+            this_thread::yield();
+        }
+    }
+}
+
+void TaskPool::parallelFor(size_t begin, size_t end, size_t grainSize, const function<void(size_t, size_t)> &body) {
+    if (grainSize == 0) {
+        grainSize = 1;
+    }
+
+    // A few chunks per thread leave some room for stealing when the chunks are not equally expensive
+    size_t chunkSize = max(grainSize, (end - begin) / (threadCount() * 4) + 1);
+
+    TaskGroup group;
+    for (size_t chunkBegin = begin; chunkBegin < end; chunkBegin += chunkSize) {
+        size_t chunkEnd = min(end, chunkBegin + chunkSize);
+        if (chunkEnd == end) {
+            body(chunkBegin, chunkEnd);
+        } else {
+            spawn(group, [&body, chunkBegin, chunkEnd] { body(chunkBegin, chunkEnd); });
+        }
+    }
+    wait(group);
+}
+
+unsigned int TaskPool::currentWorker() const {
+    return tCurrentPool == this ? tCurrentWorker : 0;
+}
+
+bool TaskPool::popLocal(unsigned int worker, QueuedTask &task) {
+    Worker &current = *mWorkers[worker];
+    lock_guard<mutex> lock(current.mLock);
+    if (current.mTasks.empty()) {
+        return false;
+    }
+    task = current.mTasks.back();
+    current.mTasks.pop_back();
+    return true;
+}
+
+bool TaskPool::steal(unsigned int thief, QueuedTask &task) {
+    for (unsigned int i = 1; i != mWorkers.size(); ++i) {
+        Worker &victim = *mWorkers[(thief + i) % mWorkers.size()];
+        lock_guard<mutex> lock(victim.mLock);
+        if (!victim.mTasks.empty()) {
+            task = victim.mTasks.front();
+            victim.mTasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskPool::runOneTask(unsigned int worker) {
+    QueuedTask task;
+    if (!popLocal(worker, task) && !steal(worker, task)) {
+        return false;
+    }
+    --mQueuedTasks;
+
+    task.mTask();
+    --task.mGroup->mPending;
+    return true;
+}
+
+void TaskPool::workerLoop(unsigned int worker) {
+    tCurrentPool = this;
+    tCurrentWorker = worker;
+
+    while (true) {
+        if (runOneTask(worker)) {
+            continue;
+        }
+
+        unique_lock<mutex> lock(mSleepLock);
+        mWakeUp.wait(lock, [this] { return mStopping || mQueuedTasks != 0; });
+        if (mStopping) {
+            return;
+        }
+    }
+}
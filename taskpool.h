@@ -0,0 +1,104 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work-stealing pool of threads. Every thread has its own deque of tasks: it pushes and pops tasks at the
+ * back, so it works depth first on its own tasks, and idle threads steal the oldest (usually the biggest)
+ * tasks from the front of other deques.
+ *
+ * The thread which creates the pool is one of its workers: it only runs tasks while it waits for a task
+ * group, so a pool with threadCount 1 doesn't start any threads at all. Tasks can spawn and wait for other
+ * tasks. The pool is meant to be used from one external thread at a time.
+ */
+class TaskPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    class TaskGroup
+    {
+    public:
+        TaskGroup() : mPending(0) {}
+
+    private:
+        friend class TaskPool;
+
+        TaskGroup(const TaskGroup&);
+        TaskGroup& operator=(const TaskGroup&);
+
+        std::atomic<unsigned int> mPending;
+    };
+
+public:
+    explicit TaskPool(unsigned int threadCount);
+    ~TaskPool();
+
+    unsigned int threadCount() const {
+        return mWorkers.size();
+    }
+
+    void spawn(TaskGroup &group, const Task &task);
+
+    // Runs the queued tasks, stealing them from other threads if needed, until all tasks spawned in the
+    // group are finished.
+    void wait(TaskGroup &group);
+
+    // Splits [begin, end) into chunks of at least grainSize elements and calls body(chunkBegin, chunkEnd)
+    // for each of them in parallel.
+    void parallelFor(size_t begin, size_t end, size_t grainSize, const std::function<void(size_t, size_t)> &body);
+
+private:
+    struct QueuedTask {
+        Task mTask;
+        TaskGroup *mGroup;
+    };
+
+    struct Worker {
+        std::mutex mLock;
+        std::deque<QueuedTask> mTasks;
+    };
+
+    TaskPool(const TaskPool&);
+    TaskPool& operator=(const TaskPool&);
+
+    unsigned int currentWorker() const;
+    bool popLocal(unsigned int worker, QueuedTask &task);
+    bool steal(unsigned int thief, QueuedTask &task);
+    bool runOneTask(unsigned int worker);
+    void workerLoop(unsigned int worker);
+
+    std::vector<std::unique_ptr<Worker> > mWorkers;
+    std::vector<std::thread> mThreads;
+
+    std::mutex mSleepLock;
+    std::condition_variable mWakeUp;
+    std::atomic<unsigned int> mQueuedTasks;
+    std::atomic<bool> mStopping;
+};
+
+#endif
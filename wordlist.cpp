@@ -0,0 +1,87 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "wordlist.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+    // Characters skipped by std::isspace in the "C" locale
+    inline bool isWhitespace(char c) {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+#ifdef __SSE2__
+    // Bit i is set if the byte i of the block is whitespace. Bytes >= 0x80 are negative as signed chars, so
+    // they never fall into the '\t'..'\r' range.
+    inline unsigned int whitespaceMask(const char *block) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+        __m128i space = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+        __m128i control = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('\t' - 1)),
+                                        _mm_cmplt_epi8(bytes, _mm_set1_epi8('\r' + 1)));
+        return _mm_movemask_epi8(_mm_or_si128(space, control));
+    }
+#endif
+
+    // Returns the first character in [position, end) which is (or isn't) whitespace, or end if there is none.
+    template <bool KWhitespace>
+    const char* find(const char *position, const char *end) {
+#ifdef __SSE2__
+        for (; end - position >= 16; position += 16) {
+            unsigned int mask = whitespaceMask(position);
+            if (!KWhitespace) {
+                mask ^= 0xFFFF;
+            }
+            if (mask != 0) {
+                return position + __builtin_ctz(mask);
+            }
+        }
+#endif
+        while (position != end && isWhitespace(*position) != KWhitespace) {
+            ++position;
+        }
+        return position;
+    }
+}
+
+bool WordTokenizer::next(Word &word) {
+    const char *wordBegin = find<false>(mPosition, mEnd);
+    if (wordBegin == mEnd) {
+        mPosition = mEnd;
+        return false;
+    }
+    mPosition = find<true>(wordBegin, mEnd);
+    word = Word(wordBegin, mPosition - wordBegin);
+    return true;
+}
+
+WordList::WordList(const char *fileName) :
+    mFile(fileName)
+{
+    // Most word lists have one short word per line, so this is usually a close upper bound.
+    mWords.reserve(mFile.size() / 8);
+
+    WordTokenizer tokenizer(mFile.data(), mFile.data() + mFile.size());
+    Word word;
+    while (tokenizer.next(word)) {
+        mWords.push_back(word);
+    }
+}
@@ -0,0 +1,120 @@
+/**
+ *  Copyright (C) 2011, Jerzy Chalupski
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef WORDLIST_H
+#define WORDLIST_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+
+/**
+ * Word stored somewhere else, usually in the mapped word list file. Words are cheap to copy and sort, but
+ * they're only valid as long as the memory they point to.
+ */
+class Word
+{
+public:
+    Word() : mData(""), mLength(0) {}
+    Word(const char *data, size_t length) : mData(data), mLength(length) {}
+
+    const char* data() const {
+        return mData;
+    }
+
+    size_t length() const {
+        return mLength;
+    }
+
+    const char* begin() const {
+        return mData;
+    }
+
+    const char* end() const {
+        return mData + mLength;
+    }
+
+    char operator[](size_t index) const {
+        return mData[index];
+    }
+
+    std::string str() const {
+        return std::string(mData, mLength);
+    }
+
+    // Same result as std::string::compare
+    int compare(const Word &other) const {
+        int result = memcmp(mData, other.mData, mLength < other.mLength ? mLength : other.mLength);
+        if (result != 0) {
+            return result;
+        }
+        return mLength < other.mLength ? -1 : (mLength > other.mLength ? 1 : 0);
+    }
+
+    bool operator<(const Word &other) const {
+        return compare(other) < 0;
+    }
+
+private:
+    const char *mData;
+    size_t mLength;
+};
+
+/**
+ * Splits a block of memory into whitespace separated words, exactly like std::istream >> std::string would.
+ */
+class WordTokenizer
+{
+public:
+    WordTokenizer(const char *begin, const char *end) : mPosition(begin), mEnd(end) {}
+
+    // Returns false when there are no more words.
+    bool next(Word &word);
+
+private:
+    const char *mPosition;
+    const char *mEnd;
+};
+
+/**
+ * Whitespace separated words from a file.
+ * The file is memory mapped and the words point straight into the mapping, so nothing is copied.
+ */
+class WordList
+{
+public:
+    // Throws std::ios_base::failure if the file cannot be read.
+    explicit WordList(const char *fileName);
+
+    std::vector<Word>& words() {
+        return mWords;
+    }
+
+    const std::vector<Word>& words() const {
+        return mWords;
+    }
+
+private:
+    WordList(const WordList&);
+    WordList& operator=(const WordList&);
+
+    MappedFile mFile;
+    std::vector<Word> mWords;
+};
+
+#endif